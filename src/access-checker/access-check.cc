@@ -0,0 +1,140 @@
+/*
+ * Copyright 2016 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "wabt/binary-reader.h"
+#include "wabt/binary-reader-ir.h"
+#include "wabt/error-formatter.h"
+#include "wabt/feature.h"
+#include "wabt/ir.h"
+#include "wabt/option-parser.h"
+#include "wabt/stream.h"
+#include "wabt/validator.h"
+
+#include "access-checker.h"
+#include "arena.h"
+#include "mapped-file.h"
+
+using namespace wabt;
+
+static int s_verbose;
+static std::string s_infile;
+static Features s_features;
+static bool s_read_debug_names = true;
+static bool s_fail_on_custom_section_error = true;
+static std::unique_ptr<FileStream> s_log_stream;
+static bool s_validate = true;
+static AccessCheckOptions s_check_options;
+static unsigned s_num_threads = 0;
+
+static const char s_description[] =
+R"(  Read a file in the WebAssembly binary format and report every
+  instruction and active segment that writes to a read-only memory or
+  table. Exits with a nonzero status if there is any.
+
+examples:
+  # memories 0 and 1 of module.wasm are read-only
+  $ access-check module.wasm --rw-memory-index 2
+  # memory 0 and table 0 are read-only
+  $ access-check module.wasm -m 1 -t 1
+)";
+
+static void ParseOptions(int argc, char** argv) {
+  OptionParser parser("access-check", s_description);
+
+  parser.AddOption('v', "verbose", "Use multiple times for more info", []() {
+    s_verbose++;
+    s_log_stream = FileStream::CreateStderr();
+  });
+  parser.AddOption(
+      'm', "rw-memory-index", "N",
+      "Memories before N are read-only",
+      [](const char* argument) {
+        s_check_options.rw_memory_index = atoi(argument);
+      });
+  parser.AddOption(
+      't', "rw-table-index", "N",
+      "Tables before N are read-only",
+      [](const char* argument) {
+        s_check_options.rw_table_index = atoi(argument);
+      });
+  parser.AddOption(
+      'j', "jobs", "N",
+      "Number of threads, by default one per core",
+      [](const char* argument) {
+        s_num_threads = std::max(1, atoi(argument));
+      });
+  s_features.AddOptions(&parser);
+  parser.AddOption("no-debug-names", "Ignore debug names in the binary file",
+                   []() { s_read_debug_names = false; });
+  parser.AddOption("ignore-custom-section-errors",
+                   "Ignore errors in custom sections",
+                   []() { s_fail_on_custom_section_error = false; });
+  parser.AddOption("no-check", "Don't check for invalid modules",
+                   []() { s_validate = false; });
+  parser.AddArgument("filename", OptionParser::ArgumentCount::One,
+                     [](const char* argument) {
+                       s_infile = argument;
+                       ConvertBackslashToSlash(&s_infile);
+                     });
+  parser.Parse(argc, argv);
+}
+
+int ProgramMain(int argc, char** argv) {
+  InitStdio();
+  ParseOptions(argc, argv);
+  EnableArena();
+
+  MappedFile file;
+  Result result = file.Open(s_infile);
+  if (Failed(result)) {
+    return 1;
+  }
+
+  Errors errors;
+  Module module;
+  const bool kStopOnFirstError = true;
+  ReadBinaryOptions options(s_features, s_log_stream.get(),
+                            s_read_debug_names, kStopOnFirstError,
+                            s_fail_on_custom_section_error);
+  file.AdviseSequential();
+  result = ReadBinaryIr(s_infile.c_str(), file.data(), file.size(), options, &errors, &module);
+  file.Release();
+
+  if (Succeeded(result) && s_validate) {
+    ValidateOptions options(s_features);
+    result = ValidateModule(&module, &errors, options);
+  }
+
+  if (Succeeded(result)) {
+    s_check_options.num_threads = s_num_threads;
+    result = CheckAccessModule(&module, &errors, s_check_options);
+  }
+  FormatErrorsToFile(errors, Location::Type::Binary);
+  FastExit(result != Result::Ok);
+}
+
+int main(int argc, char** argv) {
+  WABT_TRY
+  return ProgramMain(argc, argv);
+  WABT_CATCH_BAD_ALLOC_AND_EXIT
+}
@@ -16,152 +16,235 @@
 
 #include "access-checker.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <iterator>
+#include <memory>
+#include <string>
 
 #include "wabt/cast.h"
 #include "wabt/expr-visitor.h"
 #include "wabt/ir.h"
-#include "wabt/wast-lexer.h"
+
+#include "parallel.h"
 
 namespace wabt {
 
 namespace {
 
+// Most bodies take little time to check, so workers take runs of
+// neighbouring functions rather than contending for them one at a time.
+constexpr size_t kFuncsPerTask = 32;
+
 class MemoryAccessChecker : public ExprVisitor::DelegateNop {
  public:
-  MemoryAccessChecker(Script* script, Errors* errors, Index rw_idx);
+  MemoryAccessChecker(Module* module, const AccessCheckOptions& options);
 
-  Result VisitModule(Module* module);
-  Result VisitScript(Script* script);
+  // Checks the body of |func_index|, adding a violation to |errors| for every
+  // write to a read-only memory or table. Only reads the module, so one
+  // checker per thread can check the functions of a module concurrently.
+  Result VisitFunc(Index func_index, Errors* errors);
+  // Checks the active segments, which write at instantiation.
+  Result VisitSegments(Errors* errors);
 
   // Implementation of ExprVisitor::DelegateNop.
-  Result OnLoadExpr(LoadExpr*) override;
+  Result OnStoreExpr(StoreExpr*) override;
+  Result OnAtomicStoreExpr(AtomicStoreExpr*) override;
+  Result OnAtomicRmwExpr(AtomicRmwExpr*) override;
+  Result OnAtomicRmwCmpxchgExpr(AtomicRmwCmpxchgExpr*) override;
+  Result OnSimdStoreLaneExpr(SimdStoreLaneExpr*) override;
   Result OnMemoryCopyExpr(MemoryCopyExpr*) override;
   Result OnMemoryFillExpr(MemoryFillExpr*) override;
   Result OnMemoryGrowExpr(MemoryGrowExpr*) override;
   Result OnMemoryInitExpr(MemoryInitExpr*) override;
-  Result OnMemorySizeExpr(MemorySizeExpr*) override;
-  Result OnStoreExpr(StoreExpr*) override;
+  Result OnTableSetExpr(TableSetExpr*) override;
+  Result OnTableGrowExpr(TableGrowExpr*) override;
+  Result OnTableFillExpr(TableFillExpr*) override;
+  Result OnTableCopyExpr(TableCopyExpr*) override;
+  Result OnTableInitExpr(TableInitExpr*) override;
 
  private:
-  void VisitFunc(Func* func);
-  void VisitExport(Export* export_);
-  void VisitGlobal(Global* global);
-  void VisitTag(Tag* tag);
-  void VisitElemSegment(ElemSegment* segment);
-  void VisitDataSegment(DataSegment* segment);
-  void VisitScriptModule(ScriptModule* script_module);
-  void VisitCommand(Command* command);
-  Result CheckMemoryAccess(Var* memidx);
+  Result CheckMemoryAccess(const Var& memidx, const Location& loc, const char* what);
+  Result CheckTableAccess(const Var& table, const Location& loc, const char* what);
+  void AddViolation(const Location& loc, const std::string& message);
 
+  Module* module_;
+  const AccessCheckOptions& options_;
   Errors* errors_ = nullptr;
-  Script* script_ = nullptr;
-  Module* current_module_ = nullptr;
-  Func* current_func_ = nullptr;
-  Index rw_idx_;
+  Index current_func_index_ = kInvalidIndex;
   ExprVisitor visitor_;
-  std::vector<std::string> labels_;
   Result result_ = Result::Ok;
 };
 
-MemoryAccessChecker::MemoryAccessChecker(Script* script, Errors* errors, Index rw_idx)
-    : errors_(errors),
-      script_(script),
-      rw_idx_(rw_idx),
-      visitor_(this) {}
+MemoryAccessChecker::MemoryAccessChecker(Module* module, const AccessCheckOptions& options)
+    : module_(module), options_(options), visitor_(this) {}
+
+void MemoryAccessChecker::AddViolation(const Location& loc, const std::string& message) {
+  std::string where;
+  if (current_func_index_ != kInvalidIndex) {
+    const Func* func = module_->funcs[current_func_index_];
+    where = " in func " + std::to_string(current_func_index_);
+    if (!func->name.empty()) {
+      where += " (" + func->name + ")";
+    }
+  }
+  errors_->emplace_back(ErrorLevel::Error, loc, message + where);
+  result_ = Result::Error;
+}
 
-Result MemoryAccessChecker::OnLoadExpr(LoadExpr* expr) {
+Result MemoryAccessChecker::CheckMemoryAccess(const Var& memidx,
+                                              const Location& loc,
+                                              const char* what) {
+  Index index = module_->GetMemoryIndex(memidx);
+  if (index < options_.rw_memory_index) {
+    AddViolation(loc, std::string(what) + " to read-only memory " + std::to_string(index));
+  }
   return Result::Ok;
 }
 
-Result MemoryAccessChecker::OnMemoryCopyExpr(MemoryCopyExpr* expr) {
-  return CheckMemoryAccess(&expr->destmemidx);
+Result MemoryAccessChecker::CheckTableAccess(const Var& table,
+                                             const Location& loc,
+                                             const char* what) {
+  Index index = module_->GetTableIndex(table);
+  if (index < options_.rw_table_index) {
+    AddViolation(loc, std::string(what) + " to read-only table " + std::to_string(index));
+  }
+  return Result::Ok;
 }
 
-Result MemoryAccessChecker::OnMemoryFillExpr(MemoryFillExpr* expr) {
-  return CheckMemoryAccess(&expr->memidx);
+Result MemoryAccessChecker::OnStoreExpr(StoreExpr* expr) {
+  return CheckMemoryAccess(expr->memidx, expr->loc, "store");
 }
 
-Result MemoryAccessChecker::OnMemoryGrowExpr(MemoryGrowExpr* expr) {
-  return CheckMemoryAccess(&expr->memidx);
+Result MemoryAccessChecker::OnAtomicStoreExpr(AtomicStoreExpr* expr) {
+  return CheckMemoryAccess(expr->memidx, expr->loc, "atomic store");
 }
 
-Result MemoryAccessChecker::OnMemoryInitExpr(MemoryInitExpr* expr) {
-  return CheckMemoryAccess(&expr->memidx);
+Result MemoryAccessChecker::OnAtomicRmwExpr(AtomicRmwExpr* expr) {
+  return CheckMemoryAccess(expr->memidx, expr->loc, "atomic rmw");
 }
 
-Result MemoryAccessChecker::OnMemorySizeExpr(MemorySizeExpr* expr) {
-  return Result::Ok;
+Result MemoryAccessChecker::OnAtomicRmwCmpxchgExpr(AtomicRmwCmpxchgExpr* expr) {
+  return CheckMemoryAccess(expr->memidx, expr->loc, "atomic cmpxchg");
 }
 
-Result MemoryAccessChecker::OnStoreExpr(StoreExpr* expr) {
-  return CheckMemoryAccess(&expr->memidx);
+Result MemoryAccessChecker::OnSimdStoreLaneExpr(SimdStoreLaneExpr* expr) {
+  return CheckMemoryAccess(expr->memidx, expr->loc, "store lane");
+}
+
+// The source of a copy is only read, so copying out of a read-only memory is
+// allowed.
+Result MemoryAccessChecker::OnMemoryCopyExpr(MemoryCopyExpr* expr) {
+  return CheckMemoryAccess(expr->destmemidx, expr->loc, "memory.copy");
 }
 
-void MemoryAccessChecker::VisitFunc(Func* func) {
-  current_func_ = func;
-  visitor_.VisitFunc(func);
-  current_func_ = nullptr;
+Result MemoryAccessChecker::OnMemoryFillExpr(MemoryFillExpr* expr) {
+  return CheckMemoryAccess(expr->memidx, expr->loc, "memory.fill");
 }
 
-void MemoryAccessChecker::VisitExport(Export* export_) {
-  return;
+Result MemoryAccessChecker::OnMemoryGrowExpr(MemoryGrowExpr* expr) {
+  return CheckMemoryAccess(expr->memidx, expr->loc, "memory.grow");
 }
 
-void MemoryAccessChecker::VisitGlobal(Global* global) {
-  visitor_.VisitExprList(global->init_expr);
+Result MemoryAccessChecker::OnMemoryInitExpr(MemoryInitExpr* expr) {
+  return CheckMemoryAccess(expr->memidx, expr->loc, "memory.init");
 }
 
-void MemoryAccessChecker::VisitTag(Tag* tag) {
-  return;
+Result MemoryAccessChecker::OnTableSetExpr(TableSetExpr* expr) {
+  return CheckTableAccess(expr->var, expr->loc, "table.set");
 }
 
-void MemoryAccessChecker::VisitElemSegment(ElemSegment* segment) {
-  visitor_.VisitExprList(segment->offset);
+Result MemoryAccessChecker::OnTableGrowExpr(TableGrowExpr* expr) {
+  return CheckTableAccess(expr->var, expr->loc, "table.grow");
 }
 
-void MemoryAccessChecker::VisitDataSegment(DataSegment* segment) {
-  visitor_.VisitExprList(segment->offset);
+Result MemoryAccessChecker::OnTableFillExpr(TableFillExpr* expr) {
+  return CheckTableAccess(expr->var, expr->loc, "table.fill");
 }
 
-Result MemoryAccessChecker::VisitModule(Module* module) {
-  current_module_ = module;
+// As with memory.copy, only the destination is written.
+Result MemoryAccessChecker::OnTableCopyExpr(TableCopyExpr* expr) {
+  return CheckTableAccess(expr->dst_table, expr->loc, "table.copy");
+}
 
-  for (Func* func : module->funcs)
-    VisitFunc(func);
-  for (Export* export_ : module->exports)
-    VisitExport(export_);
-  for (Global* global : module->globals)
-    VisitGlobal(global);
-  for (Tag* tag : module->tags)
-    VisitTag(tag);
-  for (ElemSegment* elem_segment : module->elem_segments)
-    VisitElemSegment(elem_segment);
-  for (DataSegment* data_segment : module->data_segments)
-    VisitDataSegment(data_segment);
-  current_module_ = nullptr;
-  return result_;
+Result MemoryAccessChecker::OnTableInitExpr(TableInitExpr* expr) {
+  return CheckTableAccess(expr->table_index, expr->loc, "table.init");
 }
 
-Result MemoryAccessChecker::CheckMemoryAccess(Var* memidx) {
-  if (current_module_->GetMemoryIndex(*memidx) < this->rw_idx_) {
-    return Result::Error;
-  } 
-  return Result::Ok;
+Result MemoryAccessChecker::VisitFunc(Index func_index, Errors* errors) {
+  errors_ = errors;
+  current_func_index_ = func_index;
+  result_ = Result::Ok;
+  Result result = visitor_.VisitFunc(module_->funcs[func_index]);
+  current_func_index_ = kInvalidIndex;
+  errors_ = nullptr;
+  return result | result_;
 }
 
-void MemoryAccessChecker::VisitScriptModule(ScriptModule* script_module) {
-  if (auto* tsm = dyn_cast<TextScriptModule>(script_module)) {
-    VisitModule(&tsm->module);
+Result MemoryAccessChecker::VisitSegments(Errors* errors) {
+  errors_ = errors;
+  result_ = Result::Ok;
+  for (const DataSegment* segment : module_->data_segments) {
+    if (segment->kind == SegmentKind::Active) {
+      CheckMemoryAccess(segment->memory_var, segment->loc, "data segment");
+    }
   }
+  for (const ElemSegment* segment : module_->elem_segments) {
+    if (segment->kind == SegmentKind::Active) {
+      CheckTableAccess(segment->table_var, segment->loc, "elem segment");
+    }
+  }
+  errors_ = nullptr;
+  return result_;
 }
 
 }  // end anonymous namespace
 
-Result RebaseIndexModule(Module* module, Errors* errors, Index rw_idx) {
-  MemoryAccessChecker checker(nullptr, errors, rw_idx);
-  return checker.VisitModule(module);
+Result CheckAccessModule(Module* module, Errors* errors, const AccessCheckOptions& options) {
+  Index num_funcs = module->funcs.size();
+  unsigned num_workers = NumWorkers(options.num_threads, num_funcs);
+  std::vector<std::unique_ptr<MemoryAccessChecker>> checkers;
+  for (unsigned i = 0; i < std::max(num_workers, 1u); ++i) {
+    checkers.push_back(std::make_unique<MemoryAccessChecker>(module, options));
+  }
+
+  // Violations are collected per function and reported in function order,
+  // however the functions were spread over the workers.
+  std::vector<Errors> func_errors(num_funcs);
+  std::vector<Result> results(num_funcs, Result::Ok);
+  ParallelFor(
+      num_funcs, num_workers,
+      [&](unsigned worker, size_t i) {
+        results[i] = checkers[worker]->VisitFunc(i, &func_errors[i]);
+      },
+      kFuncsPerTask);
+
+  Result result = checkers[0]->VisitSegments(errors);
+  for (Index i = 0; i < num_funcs; ++i) {
+    result |= results[i];
+    std::move(func_errors[i].begin(), func_errors[i].end(), std::back_inserter(*errors));
+  }
+  return result;
+}
+
+Result CheckAccessModule(Module* module, Errors* errors, Index rw_idx) {
+  AccessCheckOptions options;
+  options.rw_memory_index = rw_idx;
+  return CheckAccessModule(module, errors, options);
+}
+
+Index RemapRwIndex(const std::vector<Index>& memory_map, Index rw_idx) {
+  Index new_rw_idx = 0;
+  for (Index i = 0; i < memory_map.size() && i < rw_idx; ++i) {
+    new_rw_idx = std::max(new_rw_idx, memory_map[i] + 1);
+  }
+  for (Index i = rw_idx; i < memory_map.size(); ++i) {
+    if (memory_map[i] < new_rw_idx) {
+      return kInvalidIndex;
+    }
+  }
+  return new_rw_idx;
 }
 
 }  // namespace wabt
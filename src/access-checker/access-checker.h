@@ -17,6 +17,8 @@
 #ifndef WABT_REBASE_INDEX_H_
 #define WABT_REBASE_INDEX_H_
 
+#include <vector>
+
 #include "wabt/common.h"
 #include "wabt/error.h"
 
@@ -24,7 +26,31 @@ namespace wabt {
 
 struct Module;
 
-Result CheckAccessModule(Module*, Errors*, Index);
+struct AccessCheckOptions {
+  // Memories and tables with a lower index are read-only.
+  Index rw_memory_index = 0;
+  Index rw_table_index = 0;
+  // Threads used to check function bodies, 0 meaning one per core.
+  unsigned num_threads = 1;
+};
+
+// Adds an error to |errors| for every instruction and active segment of the
+// module that writes to a read-only memory or table. The errors carry the
+// location of the instruction and name the function it is in, and are
+// reported in module order for any number of threads.
+Result CheckAccessModule(Module*, Errors*, const AccessCheckOptions&);
+
+// Checks memory writes only, with every memory below |rw_idx| read-only.
+Result CheckAccessModule(Module*, Errors*, Index rw_idx);
+
+// Translates an rw index of a module into the rw index of the same module
+// after its memories were merged as described by |memory_map|, the new
+// index of every old memory. Merges must not mix memories from both sides
+// of |rw_idx|; kInvalidIndex is returned if they do. For example, with
+// 0 and 1 read-only (|rw_idx| 2) and |memory_map| {0, 0, 1, 1}, the two
+// read-only memories became memory 0 and the rw index is 1; {0, 1, 1, 2}
+// merged read-only memory 1 with rw memory 2, so it is kInvalidIndex.
+Index RemapRwIndex(const std::vector<Index>& memory_map, Index rw_idx);
 
 }  // namespace wabt
 
@@ -0,0 +1,165 @@
+#include "synthetic-modules.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "wabt/binary-writer.h"
+#include "wabt/ir.h"
+#include "wabt/stream.h"
+
+namespace wabt {
+
+namespace {
+
+FuncSignature I32ToI32() {
+  FuncSignature sig;
+  sig.param_types.push_back(Type::I32);
+  sig.result_types.push_back(Type::I32);
+  return sig;
+}
+
+void SetI32ToI32(FuncDeclaration* decl) {
+  decl->has_func_type = true;
+  decl->type_var = Var(0);
+  decl->sig = I32ToI32();
+}
+
+void AppendType(Module* module) {
+  auto field = std::make_unique<TypeModuleField>();
+  auto type = std::make_unique<FuncType>();
+  type->sig = I32ToI32();
+  field->type = std::move(type);
+  module->AppendField(std::move(field));
+}
+
+// Wraps |body| in |depth| blocks yielding its i32 result.
+ExprList NestInBlocks(ExprList body, Index depth) {
+  for (Index i = 0; i < depth; ++i) {
+    auto block = std::make_unique<BlockExpr>();
+    block->block.decl.sig.result_types.push_back(Type::I32);
+    block->block.exprs = std::move(body);
+    body = ExprList();
+    body.push_back(std::move(block));
+  }
+  return body;
+}
+
+void AppendFunc(Module* module, ExprList body) {
+  auto field = std::make_unique<FuncModuleField>();
+  SetI32ToI32(&field->func.decl);
+  field->func.exprs = std::move(body);
+  module->AppendField(std::move(field));
+}
+
+void AppendFuncExport(Module* module, const std::string& name, Index func_index) {
+  auto field = std::make_unique<ExportModuleField>();
+  field->export_.name = name;
+  field->export_.kind = ExternalKind::Func;
+  field->export_.var = Var(func_index);
+  module->AppendField(std::move(field));
+}
+
+void AppendMemory(Module* module) {
+  auto field = std::make_unique<MemoryModuleField>();
+  field->memory.page_limits.initial = 1;
+  module->AppendField(std::move(field));
+}
+
+void AppendPassiveDataSegment(Module* module, Index index) {
+  auto field = std::make_unique<DataSegmentModuleField>();
+  field->data_segment.kind = SegmentKind::Passive;
+  std::string data = "segment " + std::to_string(index);
+  field->data_segment.data.assign(data.begin(), data.end());
+  module->AppendField(std::move(field));
+}
+
+// Copies nothing out of data segment |segment| and drops it; stack-neutral.
+void AppendDataSegmentUse(ExprList* body, Index segment) {
+  for (int i = 0; i < 3; ++i) {
+    body->push_back(std::make_unique<ConstExpr>(Const::I32(0)));
+  }
+  body->push_back(std::make_unique<MemoryInitExpr>(Var(segment), Var(0)));
+  body->push_back(std::make_unique<DataDropExpr>(Var(segment)));
+}
+
+Result Encode(Module* module, std::vector<uint8_t>* out) {
+  MemoryStream stream;
+  WriteBinaryOptions options;
+  CHECK_RESULT(WriteBinaryModule(&stream, module, options));
+  *out = std::move(stream.output_buffer().data);
+  return Result::Ok;
+}
+
+// Only defined functions are exported.
+Index NumLibraryExports(const SyntheticOptions& options) {
+  return std::min(options.num_exports, options.num_funcs);
+}
+
+void BuildLibrary(const SyntheticOptions& options, Module* lib) {
+  AppendType(lib);
+  if (options.num_data_segments > 0) {
+    AppendMemory(lib);
+  }
+  for (Index i = 0; i < options.num_funcs; ++i) {
+    ExprList body;
+    if (options.num_data_segments > 0 && i % 16 == 0) {
+      AppendDataSegmentUse(&body, i / 16 % options.num_data_segments);
+    }
+    body.push_back(std::make_unique<LocalGetExpr>(Var(0)));
+    body.push_back(std::make_unique<ConstExpr>(Const::I32(i)));
+    body.push_back(std::make_unique<BinaryExpr>(Opcode::I32Add));
+    AppendFunc(lib, NestInBlocks(std::move(body), options.block_depth));
+  }
+  for (Index i = 0; i < NumLibraryExports(options); ++i) {
+    AppendFuncExport(lib, "f" + std::to_string(i), i);
+  }
+  for (Index i = 0; i < options.num_data_segments; ++i) {
+    AppendPassiveDataSegment(lib, i);
+  }
+}
+
+void BuildApp(const SyntheticOptions& options, Module* app) {
+  AppendType(app);
+  Index num_imports = std::min(options.num_imports, NumLibraryExports(options));
+  for (Index i = 0; i < num_imports; ++i) {
+    auto field = std::make_unique<ImportModuleField>();
+    auto import = std::make_unique<FuncImport>();
+    import->module_name = "lib";
+    import->field_name = "f" + std::to_string(i);
+    SetI32ToI32(&import->func.decl);
+    field->import = std::move(import);
+    app->AppendField(std::move(field));
+  }
+  for (Index i = 0; i < options.num_funcs; ++i) {
+    ExprList body;
+    body.push_back(std::make_unique<LocalGetExpr>(Var(0)));
+    if (num_imports > 0) {
+      body.push_back(std::make_unique<CallExpr>(Var(i % num_imports)));
+    }
+    if (i > 0) {
+      body.push_back(std::make_unique<CallExpr>(Var(num_imports + i - 1)));
+    }
+    AppendFunc(app, NestInBlocks(std::move(body), options.block_depth));
+  }
+  // The app is the root of the link, so it exports what it defines last.
+  if (options.num_funcs > 0) {
+    AppendFuncExport(app, "main", num_imports + options.num_funcs - 1);
+  }
+}
+
+}  // end anonymous namespace
+
+Result GenerateModulePair(const SyntheticOptions& options,
+                          std::vector<uint8_t>* app,
+                          std::vector<uint8_t>* lib) {
+  Module lib_module;
+  BuildLibrary(options, &lib_module);
+  CHECK_RESULT(Encode(&lib_module, lib));
+
+  Module app_module;
+  BuildApp(options, &app_module);
+  return Encode(&app_module, app);
+}
+
+}  // namespace wabt
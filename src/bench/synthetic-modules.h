@@ -0,0 +1,37 @@
+#ifndef WABT_SYNTHETIC_MODULES_H_
+#define WABT_SYNTHETIC_MODULES_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+struct SyntheticOptions {
+  // Functions defined by each of the two modules.
+  Index num_funcs = 1000;
+  // Functions the app imports from the library, at most |num_exports|.
+  Index num_imports = 100;
+  // Functions the library exports, named "f0", "f1", ..., at most
+  // |num_funcs|.
+  Index num_exports = 100;
+  // Blocks nested around the body of every function.
+  Index block_depth = 4;
+  // Passive data segments of the library, which then has a memory.
+  Index num_data_segments = 4;
+};
+
+// Encodes a library module named "lib" and an app module importing from it.
+// Every function has type (i32) -> i32; app functions call one import and
+// the app function defined before them, library functions add a constant.
+// With data segments, every 16th library function also runs memory.init
+// and data.drop on one of them, so the library needs a DataCount section.
+// The modules are valid and link without unresolved imports.
+Result GenerateModulePair(const SyntheticOptions&,
+                          std::vector<uint8_t>* app,
+                          std::vector<uint8_t>* lib);
+
+}  // namespace wabt
+
+#endif /* WABT_SYNTHETIC_MODULES_H_ */
@@ -0,0 +1,364 @@
+/*
+ * Copyright 2016 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "wabt/apply-names.h"
+#include "wabt/binary-reader.h"
+#include "wabt/binary-reader-ir.h"
+#include "wabt/binary-writer.h"
+#include "wabt/error-formatter.h"
+#include "wabt/feature.h"
+#include "wabt/ir.h"
+#include "wabt/option-parser.h"
+#include "wabt/resolve-names.h"
+#include "wabt/stream.h"
+#include "wabt/validator.h"
+
+#include "batch-manifest.h"
+#include "combine-modules.h"
+#include "export-rewriter.h"
+#include "generate-prefix-names.h"
+#include "parallel-binary-writer.h"
+#include "resolve-imports.h"
+#include "section-reader.h"
+#include "synthetic-modules.h"
+
+using namespace wabt;
+
+// Every allocation of the process is counted, so the stages report how much
+// they allocate as well as how long they take.
+static std::atomic<uint64_t> s_allocations{0};
+static std::atomic<uint64_t> s_allocated_bytes{0};
+
+void* operator new(size_t size) {
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+  s_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* p = malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
+
+static SyntheticOptions s_synthetic_options;
+static unsigned s_iterations = 5;
+static unsigned s_num_threads = 1;
+static std::string s_outfile;
+
+static const char s_description[] =
+R"(  Generate a synthetic app and library module pair, link them the way
+  wasmlink does and time every stage, along with the import scan of
+  import-check and the export rewrite of export-audit. Prints the results
+  as JSON.
+
+examples:
+  # 10000 functions per module, nested 8 blocks deep, best of 10 runs
+  $ wasm-tools-bench --funcs 10000 --depth 8 --iterations 10 -o bench.json
+)";
+
+static void ParseOptions(int argc, char** argv) {
+  OptionParser parser("wasm-tools-bench", s_description);
+
+  parser.AddOption("funcs", "N", "Functions defined by each module",
+                   [](const char* argument) { s_synthetic_options.num_funcs = atoi(argument); });
+  parser.AddOption("imports", "N", "Functions the app imports from the library",
+                   [](const char* argument) { s_synthetic_options.num_imports = atoi(argument); });
+  parser.AddOption("exports", "N", "Functions the library exports",
+                   [](const char* argument) { s_synthetic_options.num_exports = atoi(argument); });
+  parser.AddOption("depth", "N", "Blocks nested around every function body",
+                   [](const char* argument) { s_synthetic_options.block_depth = atoi(argument); });
+  parser.AddOption("data-segments", "N",
+                   "Passive data segments of the library, used by memory.init and data.drop,"
+                   " default 4",
+                   [](const char* argument) {
+                     s_synthetic_options.num_data_segments = atoi(argument);
+                   });
+  parser.AddOption("iterations", "N", "Times every stage is run, default 5",
+                   [](const char* argument) { s_iterations = std::max(1, atoi(argument)); });
+  parser.AddOption(
+      'j', "jobs", "N",
+      "Number of threads for the stages that can use several, default 1",
+      [](const char* argument) {
+        s_num_threads = std::max(1, atoi(argument));
+      });
+  parser.AddOption(
+      'o', "output", "FILENAME",
+      "Write the JSON results to FILENAME instead of stdout",
+      [](const char* argument) {
+        s_outfile = argument;
+        ConvertBackslashToSlash(&s_outfile);
+      });
+  parser.Parse(argc, argv);
+}
+
+struct BenchInputs {
+  std::vector<uint8_t> app;
+  std::vector<uint8_t> lib;
+};
+
+struct StageResult {
+  std::string name;
+  std::vector<double> seconds;
+  // Per run; the stages are deterministic, so every run allocates the same.
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+  // What one run processes.
+  size_t funcs = 0;
+  size_t bytes = 0;
+};
+
+class StageRunner {
+ public:
+  explicit StageRunner(std::vector<StageResult>* stages) : stages_(stages) {}
+
+  // Runs |fn| as the next stage of this iteration.
+  Result Run(const char* name, size_t funcs, size_t bytes, const std::function<Result()>& fn);
+
+ private:
+  std::vector<StageResult>* stages_;
+  size_t next_ = 0;
+};
+
+Result StageRunner::Run(const char* name,
+                        size_t funcs,
+                        size_t bytes,
+                        const std::function<Result()>& fn) {
+  if (next_ == stages_->size()) {
+    stages_->emplace_back();
+    stages_->back().name = name;
+  }
+  StageResult& stage = (*stages_)[next_++];
+  stage.funcs = funcs;
+  stage.bytes = bytes;
+
+  uint64_t allocations = s_allocations.load(std::memory_order_relaxed);
+  uint64_t allocated_bytes = s_allocated_bytes.load(std::memory_order_relaxed);
+  auto start = std::chrono::steady_clock::now();
+  Result result = fn();
+  auto end = std::chrono::steady_clock::now();
+  stage.allocations = s_allocations.load(std::memory_order_relaxed) - allocations;
+  stage.allocated_bytes = s_allocated_bytes.load(std::memory_order_relaxed) - allocated_bytes;
+  stage.seconds.push_back(std::chrono::duration<double>(end - start).count());
+  return result;
+}
+
+static Result ReadModule(const char* filename,
+                         const std::vector<uint8_t>& data,
+                         const char* name,
+                         Errors* errors,
+                         Module* module) {
+  Features features;
+  const bool kReadDebugNames = true;
+  const bool kStopOnFirstError = true;
+  const bool kFailOnCustomSectionError = true;
+  ReadBinaryOptions options(features, nullptr, kReadDebugNames, kStopOnFirstError,
+                            kFailOnCustomSectionError);
+  CHECK_RESULT(ReadBinaryIr(filename, data.data(), data.size(), options, errors, module));
+  module->name = name;
+  return Result::Ok;
+}
+
+static Result RunIteration(const BenchInputs& inputs,
+                           bool validate,
+                           Errors* errors,
+                           std::vector<StageResult>* stages) {
+  StageRunner runner(stages);
+  const size_t link_bytes = inputs.app.size() + inputs.lib.size();
+  Module app;
+  Module lib;
+  std::vector<Module*> modules = {&app, &lib};
+
+  CHECK_RESULT(runner.Run("read", 2 * s_synthetic_options.num_funcs, link_bytes, [&]() {
+    CHECK_RESULT(ReadModule("app.wasm", inputs.app, "app", errors, &app));
+    return ReadModule("lib.wasm", inputs.lib, "lib", errors, &lib);
+  }));
+  const size_t link_funcs = app.funcs.size() + lib.funcs.size();
+
+  CHECK_RESULT(runner.Run("prefix-names", link_funcs, link_bytes, [&]() {
+    CHECK_RESULT(GeneratePrefixNames(&app, PrefixNameOpts::PrefixNone, s_num_threads));
+    return GeneratePrefixNames(&lib, PrefixNameOpts::PrefixNone, s_num_threads);
+  }));
+
+  ImportMap import_map;
+  CHECK_RESULT(runner.Run("resolve-imports", link_funcs, link_bytes, [&]() {
+    CHECK_RESULT(BuildImportMap(modules, &import_map, errors));
+    return ResolveImports(modules, import_map);
+  }));
+
+  CHECK_RESULT(runner.Run("apply-names", link_funcs, link_bytes, [&]() {
+    CHECK_RESULT(ApplyNames(&app));
+    return ApplyNames(&lib);
+  }));
+
+  Module output;
+  CHECK_RESULT(runner.Run("combine", link_funcs, link_bytes, [&]() {
+    return CombineModules(modules, &output);
+  }));
+
+  CHECK_RESULT(runner.Run("resolve-names", link_funcs, link_bytes, [&]() {
+    return ResolveNamesModule(&output, errors);
+  }));
+
+  // Not timed: only makes sure the stages above did what wasmlink needs.
+  if (validate) {
+    Features features;
+    ValidateOptions options(features);
+    CHECK_RESULT(ValidateModule(&output, errors, options));
+  }
+
+  WriteBinaryOptions write_options;
+  MemoryStream encoded;
+  CHECK_RESULT(runner.Run("write", link_funcs, link_bytes, [&]() {
+    encoded.Clear();
+    return WriteBinaryModuleParallel(&encoded, &output, write_options, s_num_threads);
+  }));
+  // With several threads whatever -j is, so the check covers the sharded
+  // encoding, and its DataCount section, even when the timed run doesn't.
+  if (validate) {
+    const unsigned kCheckThreads = 4;
+    MemoryStream serial;
+    MemoryStream parallel;
+    CHECK_RESULT(WriteBinaryModule(&serial, &output, write_options));
+    CHECK_RESULT(WriteBinaryModuleParallel(&parallel, &output, write_options, kCheckThreads));
+    if (serial.output_buffer().data != encoded.output_buffer().data
+        || serial.output_buffer().data != parallel.output_buffer().data) {
+      errors->emplace_back(ErrorLevel::Error, Location(), "parallel encoding differs from the serial one");
+      return Result::Error;
+    }
+  }
+
+  CHECK_RESULT(runner.Run("import-check", s_synthetic_options.num_funcs, inputs.app.size(), [&]() {
+    size_t num_imports = 0;
+    CHECK_RESULT(ScanImports("app.wasm", inputs.app.data(), inputs.app.size(), errors,
+                             [&](const ImportInfo&) {
+                               ++num_imports;
+                               return true;
+                             }));
+    return num_imports == import_map[0].funcs.size() ? Result::Ok : Result::Error;
+  }));
+
+  // Drops every other export, like an audit with a policy would.
+  return runner.Run("export-audit", s_synthetic_options.num_funcs, inputs.lib.size(), [&]() {
+    MemoryStream stream;
+    size_t index = 0;
+    return RewriteExports("lib.wasm", inputs.lib.data(), inputs.lib.size(), errors,
+                          [&](std::string_view) { return index++ % 2 == 0; }, &stream);
+  });
+}
+
+static std::string FormatDouble(double value) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.9g", value);
+  return buffer;
+}
+
+static std::string ResultsJson(const BenchInputs& inputs, std::vector<StageResult>* stages) {
+  const SyntheticOptions& options = s_synthetic_options;
+  std::string json = "{\"benchmark\":\"wasm-tools-bench\",\"format\":1";
+  json += ",\"config\":{\"funcs\":" + std::to_string(options.num_funcs)
+          + ",\"imports\":" + std::to_string(options.num_imports)
+          + ",\"exports\":" + std::to_string(options.num_exports)
+          + ",\"block_depth\":" + std::to_string(options.block_depth)
+          + ",\"data_segments\":" + std::to_string(options.num_data_segments)
+          + ",\"iterations\":" + std::to_string(s_iterations)
+          + ",\"threads\":" + std::to_string(s_num_threads) + "}";
+  json += ",\"inputs\":{\"app_bytes\":" + std::to_string(inputs.app.size())
+          + ",\"lib_bytes\":" + std::to_string(inputs.lib.size()) + "}";
+  json += ",\"stages\":[";
+  for (size_t i = 0; i < stages->size(); ++i) {
+    StageResult& stage = (*stages)[i];
+    std::sort(stage.seconds.begin(), stage.seconds.end());
+    double min_seconds = stage.seconds.front();
+    double median_seconds = stage.seconds[stage.seconds.size() / 2];
+    // Throughput of the fastest run, the one least disturbed by the system.
+    double per_second = min_seconds > 0 ? 1 / min_seconds : 0;
+    json += std::string(i ? "," : "") + "{\"name\":" + JsonString(stage.name)
+            + ",\"min_seconds\":" + FormatDouble(min_seconds)
+            + ",\"median_seconds\":" + FormatDouble(median_seconds)
+            + ",\"funcs_per_second\":" + FormatDouble(stage.funcs * per_second)
+            + ",\"bytes_per_second\":" + FormatDouble(stage.bytes * per_second)
+            + ",\"allocations\":" + std::to_string(stage.allocations)
+            + ",\"allocated_bytes\":" + std::to_string(stage.allocated_bytes) + "}";
+  }
+  return json + "]}\n";
+}
+
+int ProgramMain(int argc, char** argv) {
+  InitStdio();
+  ParseOptions(argc, argv);
+
+  BenchInputs inputs;
+  Result result = GenerateModulePair(s_synthetic_options, &inputs.app, &inputs.lib);
+
+  std::vector<StageResult> stages;
+  Errors errors;
+  for (unsigned i = 0; i < s_iterations && Succeeded(result); ++i) {
+    result = RunIteration(inputs, i == 0, &errors, &stages);
+  }
+  FormatErrorsToFile(errors, Location::Type::Binary);
+  if (Failed(result)) {
+    std::cerr << "benchmark failed" << std::endl;
+    return 1;
+  }
+
+  std::string json = ResultsJson(inputs, &stages);
+  FILE* file = s_outfile.empty() ? stdout : fopen(s_outfile.c_str(), "w");
+  if (!file) {
+    std::cerr << "unable to open " << s_outfile << " for writing" << std::endl;
+    return 1;
+  }
+  fwrite(json.data(), 1, json.size(), file);
+  if (file != stdout) {
+    fclose(file);
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  WABT_TRY
+  return ProgramMain(argc, argv);
+  WABT_CATCH_BAD_ALLOC_AND_EXIT
+}
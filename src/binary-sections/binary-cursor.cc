@@ -0,0 +1,108 @@
+#include "binary-cursor.h"
+
+namespace wabt {
+
+bool BinaryCursor::ReadU8(uint8_t* out) {
+  if (at_end()) {
+    return false;
+  }
+  *out = data_[offset_++];
+  return true;
+}
+
+bool BinaryCursor::ReadU32Leb128(uint32_t* out) {
+  uint64_t value;
+  size_t start = offset_;
+  if (!ReadU64Leb128(&value) || offset_ - start > 5 || value > UINT32_MAX) {
+    offset_ = start;
+    return false;
+  }
+  *out = static_cast<uint32_t>(value);
+  return true;
+}
+
+bool BinaryCursor::ReadU64Leb128(uint64_t* out) {
+  uint64_t value = 0;
+  size_t p = offset_;
+  for (unsigned shift = 0; shift < 70; shift += 7) {
+    if (p >= size_) {
+      return false;
+    }
+    uint8_t byte = data_[p++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      offset_ = p;
+      *out = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BinaryCursor::SkipLeb128(size_t max_bytes) {
+  size_t p = offset_;
+  for (size_t i = 0; i < max_bytes; ++i) {
+    if (p >= size_) {
+      return false;
+    }
+    if (!(data_[p++] & 0x80)) {
+      offset_ = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BinaryCursor::ReadString(std::string_view* out) {
+  size_t start = offset_;
+  uint32_t length;
+  if (!ReadU32Leb128(&length) || length > remaining()) {
+    offset_ = start;
+    return false;
+  }
+  *out = std::string_view(reinterpret_cast<const char*>(pos()), length);
+  offset_ += length;
+  return true;
+}
+
+bool BinaryCursor::Skip(size_t size) {
+  if (size > remaining()) {
+    return false;
+  }
+  offset_ += size;
+  return true;
+}
+
+bool BinaryCursor::SkipValueType() {
+  size_t start = offset_;
+  uint8_t type;
+  if (!ReadU8(&type)) {
+    return false;
+  }
+  // (ref null? ht) carries a signed 33-bit heap type.
+  if ((type == 0x63 || type == 0x64) && !SkipLeb128(5)) {
+    offset_ = start;
+    return false;
+  }
+  return true;
+}
+
+bool BinaryCursor::SkipLimits() {
+  size_t start = offset_;
+  uint32_t flags;
+  uint64_t value;
+  bool ok = ReadU32Leb128(&flags) && ReadU64Leb128(&value);
+  if (ok && (flags & 0x01)) {
+    ok = ReadU64Leb128(&value);
+  }
+  // Custom page sizes append the page size as log2.
+  if (ok && (flags & 0x08)) {
+    ok = ReadU64Leb128(&value);
+  }
+  if (!ok) {
+    offset_ = start;
+  }
+  return ok;
+}
+
+}  // namespace wabt
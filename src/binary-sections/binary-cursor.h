@@ -0,0 +1,60 @@
+#ifndef WABT_BINARY_CURSOR_H_
+#define WABT_BINARY_CURSOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+// Bounds-checked reader over wasm binary bytes. Every Read* returns false,
+// without moving, when the value doesn't fit in the remaining bytes or is
+// malformed.
+class BinaryCursor {
+ public:
+  BinaryCursor(const uint8_t* data, size_t size, size_t offset = 0)
+      : data_(data), size_(size), offset_(offset) {}
+
+  size_t offset() const { return offset_; }
+  size_t remaining() const { return size_ - offset_; }
+  bool at_end() const { return offset_ >= size_; }
+  const uint8_t* pos() const { return data_ + offset_; }
+
+  bool ReadU8(uint8_t* out);
+  bool ReadU32Leb128(uint32_t* out);
+  bool ReadU64Leb128(uint64_t* out);
+  // Skips a signed or unsigned LEB128 of at most |max_bytes| bytes.
+  bool SkipLeb128(size_t max_bytes);
+  // A length-prefixed byte string, e.g. a name.
+  bool ReadString(std::string_view* out);
+  bool Skip(size_t size);
+
+  // Skips a value type, including the typed reference encodings.
+  bool SkipValueType();
+  // Skips a table or memory limits entry.
+  bool SkipLimits();
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t offset_;
+};
+
+// Appends the canonical (shortest) LEB128 encoding of |value|.
+template <typename Container>
+void AppendU32Leb128(Container* out, uint32_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if (value != 0) {
+      byte |= 0x80;
+    }
+    out->push_back(byte);
+  } while (value != 0);
+}
+
+}  // namespace wabt
+
+#endif /* WABT_BINARY_CURSOR_H_ */
@@ -0,0 +1,89 @@
+#include "export-rewriter.h"
+
+#include <vector>
+
+#include "wabt/stream.h"
+
+#include "binary-cursor.h"
+#include "section-reader.h"
+
+namespace wabt {
+
+namespace {
+
+// Builds the payload of the filtered export section in |payload|.
+Result FilterExports(SectionReader* reader,
+                     const SectionInfo& section,
+                     const std::function<bool(std::string_view name)>& keep,
+                     std::vector<uint8_t>* payload) {
+  BinaryCursor cursor(reader->data(), section.end(), section.payload_offset);
+  uint32_t count;
+  if (!cursor.ReadU32Leb128(&count)) {
+    reader->Error(cursor.offset(), "unable to read export count");
+    return Result::Error;
+  }
+
+  std::vector<uint8_t> entries;
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    size_t start = cursor.offset();
+    std::string_view name;
+    uint8_t kind;
+    uint32_t index;
+    if (!cursor.ReadString(&name) || !cursor.ReadU8(&kind) || !cursor.ReadU32Leb128(&index)) {
+      reader->Error(start, "unable to read export entry");
+      return Result::Error;
+    }
+    if (keep(name)) {
+      entries.insert(entries.end(), reader->data() + start, cursor.pos());
+      kept++;
+    }
+  }
+  if (!cursor.at_end()) {
+    reader->Error(cursor.offset(), "export section has trailing bytes");
+    return Result::Error;
+  }
+
+  payload->clear();
+  AppendU32Leb128(payload, kept);
+  payload->insert(payload->end(), entries.begin(), entries.end());
+  return Result::Ok;
+}
+
+}  // end anonymous namespace
+
+Result RewriteExports(const char* filename,
+                      const uint8_t* data,
+                      size_t size,
+                      Errors* errors,
+                      const std::function<bool(std::string_view name)>& keep,
+                      Stream* out) {
+  SectionReader reader(filename, data, size, errors);
+  CHECK_RESULT(reader.ReadHeader());
+
+  // Runs of untouched sections are written with a single call.
+  size_t copy_start = 0;
+  SectionInfo section;
+  while (reader.Next(&section)) {
+    if (section.id != BinarySection::Export) {
+      continue;
+    }
+
+    std::vector<uint8_t> payload;
+    CHECK_RESULT(FilterExports(&reader, section, keep, &payload));
+    out->WriteData(data + copy_start, section.offset - copy_start, "sections");
+
+    std::vector<uint8_t> header;
+    header.push_back(static_cast<uint8_t>(BinarySection::Export));
+    AppendU32Leb128(&header, payload.size());
+    out->WriteData(header.data(), header.size(), "export section header");
+    out->WriteData(payload.data(), payload.size(), "export section");
+    copy_start = section.end();
+  }
+  CHECK_RESULT(reader.result());
+
+  out->WriteData(data + copy_start, size - copy_start, "sections");
+  return out->result();
+}
+
+}  // namespace wabt
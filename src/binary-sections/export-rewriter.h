@@ -0,0 +1,28 @@
+#ifndef WABT_EXPORT_REWRITER_H_
+#define WABT_EXPORT_REWRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+#include "wabt/common.h"
+#include "wabt/error.h"
+
+namespace wabt {
+
+class Stream;
+
+// Writes the binary module in |data| to |out|, copying every section
+// byte-for-byte except the export section, which keeps only the entries for
+// which |keep| returns true. Nothing but the export section is decoded.
+Result RewriteExports(const char* filename,
+                      const uint8_t* data,
+                      size_t size,
+                      Errors* errors,
+                      const std::function<bool(std::string_view name)>& keep,
+                      Stream* out);
+
+}  // namespace wabt
+
+#endif /* WABT_EXPORT_REWRITER_H_ */
@@ -0,0 +1,238 @@
+#include "lazy-module.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "wabt/binary-reader-ir.h"
+#include "wabt/stream.h"
+
+#include "binary-cursor.h"
+#include "section-reader.h"
+
+namespace wabt {
+
+namespace {
+
+struct Body {
+  const uint8_t* data;
+  size_t size;
+};
+
+// An empty body: no local declarations, then `end`.
+const uint8_t kStubBody[] = {0x00, 0x0b};
+
+Result ReadBodies(SectionReader* reader,
+                  const SectionInfo& section,
+                  std::vector<Body>* bodies) {
+  std::vector<FunctionBody> entries;
+  CHECK_RESULT(ReadFunctionBodies(reader, section, &entries));
+  bodies->clear();
+  for (const FunctionBody& entry : entries) {
+    bodies->push_back({reader->data() + entry.body_offset, entry.end - entry.body_offset});
+  }
+  return Result::Ok;
+}
+
+// Finds the code section of the module in |reader|. |section->offset| is 0 if
+// there is none. |has_data_count| tells whether a DataCount section precedes
+// it.
+Result FindCodeSection(SectionReader* reader, SectionInfo* section, bool* has_data_count) {
+  CHECK_RESULT(reader->ReadHeader());
+  section->offset = 0;
+  *has_data_count = false;
+  SectionInfo info;
+  while (reader->Next(&info)) {
+    if (info.id == BinarySection::DataCount) {
+      *has_data_count = true;
+    } else if (info.id == BinarySection::Code) {
+      *section = info;
+      return Result::Ok;
+    }
+  }
+  return reader->result();
+}
+
+// A DataCount section announcing |count| data segments.
+std::vector<uint8_t> DataCountSection(Index count) {
+  std::vector<uint8_t> payload;
+  AppendU32Leb128(&payload, count);
+  std::vector<uint8_t> section;
+  section.push_back(static_cast<uint8_t>(BinarySection::DataCount));
+  AppendU32Leb128(&section, payload.size());
+  section.insert(section.end(), payload.begin(), payload.end());
+  return section;
+}
+
+// Returns the module |data| with the code section in [code_offset, code_end)
+// replaced by |before_code| and then a code section holding |bodies|.
+std::vector<uint8_t> SpliceCode(const uint8_t* data,
+                                size_t size,
+                                size_t code_offset,
+                                size_t code_end,
+                                const std::vector<Body>& bodies,
+                                const std::vector<uint8_t>& before_code = {}) {
+  std::vector<uint8_t> payload;
+  AppendU32Leb128(&payload, bodies.size());
+  for (const Body& body : bodies) {
+    AppendU32Leb128(&payload, body.size);
+    payload.insert(payload.end(), body.data, body.data + body.size);
+  }
+
+  std::vector<uint8_t> out;
+  out.reserve(code_offset + before_code.size() + payload.size() + 6 + (size - code_end));
+  out.insert(out.end(), data, data + code_offset);
+  out.insert(out.end(), before_code.begin(), before_code.end());
+  out.push_back(static_cast<uint8_t>(BinarySection::Code));
+  AppendU32Leb128(&out, payload.size());
+  out.insert(out.end(), payload.begin(), payload.end());
+  out.insert(out.end(), data + code_end, data + size);
+  return out;
+}
+
+}  // end anonymous namespace
+
+Result LazyModule::Read(const char* filename,
+                        const uint8_t* data,
+                        size_t size,
+                        const ReadBinaryOptions& options,
+                        Errors* errors) {
+  filename_ = filename;
+  data_ = data;
+  size_ = size;
+  options_ = options;
+
+  SectionReader reader(filename, data, size, errors);
+  SectionInfo code;
+  CHECK_RESULT(FindCodeSection(&reader, &code, &has_data_count_));
+  if (code.offset == 0) {
+    return ReadBinaryIr(filename, data, size, options, errors, &module_);
+  }
+
+  std::vector<Body> bodies;
+  CHECK_RESULT(ReadBodies(&reader, code, &bodies));
+  code_offset_ = code.offset;
+  code_end_ = code.end();
+  bodies_.clear();
+  for (const Body& body : bodies) {
+    bodies_.push_back({static_cast<size_t>(body.data - data), body.size});
+  }
+  materialized_.assign(bodies_.size(), false);
+
+  std::vector<Body> stubs(bodies.size(), Body{kStubBody, sizeof(kStubBody)});
+  std::vector<uint8_t> stubbed = SpliceCode(data, size, code_offset_, code_end_, stubs);
+  CHECK_RESULT(ReadBinaryIr(filename, stubbed.data(), stubbed.size(), options, errors, &module_));
+  index_space_sizes_ = IndexSpaceSizes();
+  return Result::Ok;
+}
+
+std::vector<size_t> LazyModule::IndexSpaceSizes() const {
+  return {module_.types.size(),
+          module_.funcs.size(),
+          module_.tables.size(),
+          module_.memories.size(),
+          module_.globals.size(),
+          module_.tags.size(),
+          module_.data_segments.size(),
+          module_.elem_segments.size()};
+}
+
+bool LazyModule::is_materialized(Index func_index) const {
+  return func_index < materialized_.size() && materialized_[func_index];
+}
+
+Result LazyModule::Materialize(const std::vector<Index>& func_indices, Errors* errors) {
+  std::vector<Body> bodies(bodies_.size(), Body{kStubBody, sizeof(kStubBody)});
+  bool any = false;
+  for (Index func_index : func_indices) {
+    if (func_index >= bodies_.size()) {
+      errors->emplace_back(ErrorLevel::Error, Location(),
+                           "function index " + std::to_string(func_index) + " out of range");
+      return Result::Error;
+    }
+    if (!materialized_[func_index]) {
+      bodies[func_index] = {data_ + bodies_[func_index].offset, bodies_[func_index].size};
+      any = true;
+    }
+  }
+  if (!any) {
+    return Result::Ok;
+  }
+
+  // The rest of the module is decoded again so the bodies can be; only the
+  // chosen ones are taken from the result.
+  std::vector<uint8_t> binary = SpliceCode(data_, size_, code_offset_, code_end_, bodies);
+  Module decoded;
+  CHECK_RESULT(ReadBinaryIr(filename_, binary.data(), binary.size(), options_, errors, &decoded));
+
+  for (Index func_index : func_indices) {
+    if (materialized_[func_index]) {
+      continue;
+    }
+    Func* from = decoded.funcs[module_.num_func_imports + func_index];
+    Func* to = module_.funcs[module_.num_func_imports + func_index];
+    to->local_types = std::move(from->local_types);
+    to->exprs = std::move(from->exprs);
+    to->bindings = std::move(from->bindings);
+    materialized_[func_index] = true;
+  }
+  return Result::Ok;
+}
+
+Result LazyModule::MaterializeAll(Errors* errors) {
+  std::vector<Index> func_indices;
+  for (Index i = 0; i < bodies_.size(); ++i) {
+    func_indices.push_back(i);
+  }
+  return Materialize(func_indices, errors);
+}
+
+Result LazyModule::Write(Stream* stream, const WriteBinaryOptions& options, Errors* errors) {
+  MemoryStream encoded;
+  CHECK_RESULT(WriteBinaryModule(&encoded, &module_, options));
+  const OutputBuffer& buffer = encoded.output_buffer();
+  if (code_end_ == 0) {
+    stream->WriteData(buffer.data.data(), buffer.size(), "module");
+    return Result::Ok;
+  }
+
+  SectionReader reader(filename_, buffer.data.data(), buffer.size(), errors);
+  SectionInfo code;
+  bool has_data_count;
+  CHECK_RESULT(FindCodeSection(&reader, &code, &has_data_count));
+  std::vector<Body> bodies;
+  if (code.offset != 0) {
+    CHECK_RESULT(ReadBodies(&reader, code, &bodies));
+  }
+  if (bodies.size() != bodies_.size()) {
+    errors->emplace_back(ErrorLevel::Error, Location(),
+                         "functions were added or removed from a lazily read module");
+    return Result::Error;
+  }
+  bool all_materialized =
+      std::find(materialized_.begin(), materialized_.end(), false) == materialized_.end();
+  if (!all_materialized && IndexSpaceSizes() != index_space_sizes_) {
+    errors->emplace_back(ErrorLevel::Error, Location(),
+                         "an index space of a lazily read module was renumbered while bodies"
+                         " referring to it weren't materialized");
+    return Result::Error;
+  }
+
+  for (size_t i = 0; i < bodies.size(); ++i) {
+    if (!materialized_[i]) {
+      bodies[i] = {data_ + bodies_[i].offset, bodies_[i].size};
+    }
+  }
+  // The writer only keeps a DataCount section for the bodies it encoded, and
+  // the copied ones may need it as well.
+  std::vector<uint8_t> data_count;
+  if (has_data_count_ && !has_data_count) {
+    data_count = DataCountSection(module_.data_segments.size());
+  }
+  std::vector<uint8_t> out = SpliceCode(buffer.data.data(), buffer.size(), code.offset,
+                                        code.end(), bodies, data_count);
+  stream->WriteData(out.data(), out.size(), "module");
+  return Result::Ok;
+}
+
+}  // namespace wabt
@@ -0,0 +1,82 @@
+#ifndef WABT_LAZY_MODULE_H_
+#define WABT_LAZY_MODULE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "wabt/binary-reader.h"
+#include "wabt/binary-writer.h"
+#include "wabt/common.h"
+#include "wabt/error.h"
+#include "wabt/ir.h"
+
+namespace wabt {
+
+class Stream;
+
+// A module decoded without its function bodies, for passes that only touch
+// metadata. Reading it costs O(metadata) rather than O(code size): every
+// body is kept as a byte range of the input and left out of the IR, where
+// its Func has no locals and no expressions, until it is materialized.
+// Bodies that are never materialized are written back verbatim.
+//
+// The IR is decoded from a copy of the input whose bodies are stubbed out,
+// so error offsets past the code section don't match the input.
+class LazyModule {
+ public:
+  // |data| must stay valid until the module is written.
+  Result Read(const char* filename,
+              const uint8_t* data,
+              size_t size,
+              const ReadBinaryOptions& options,
+              Errors* errors);
+
+  Module* module() { return &module_; }
+
+  // |func_index| counts defined functions only, as do the indices below.
+  bool is_materialized(Index func_index) const;
+
+  // Decodes the bodies of the defined functions |func_indices| into the IR,
+  // in one pass over the metadata however many there are.
+  Result Materialize(const std::vector<Index>& func_indices, Errors* errors);
+  Result MaterializeAll(Errors* errors);
+
+  // Writes the module, copying the input bytes of every body that wasn't
+  // materialized. Those bytes refer to everything by its index in the input,
+  // so passes must not renumber any index space: types, functions, tables,
+  // memories, globals, tags and data and elem segments may only be changed in
+  // place. Fails if an index space no longer has the size that was read
+  // while a body is still unmaterialized.
+  Result Write(Stream* stream, const WriteBinaryOptions& options, Errors* errors);
+
+ private:
+  std::vector<size_t> IndexSpaceSizes() const;
+
+  struct BodyRange {
+    // Of the body bytes that follow the size.
+    size_t offset;
+    size_t size;
+  };
+
+  const char* filename_ = nullptr;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  ReadBinaryOptions options_;
+  // Empty when the input has no code section.
+  std::vector<BodyRange> bodies_;
+  size_t code_offset_ = 0;
+  size_t code_end_ = 0;
+  // The size of every index space as read, in the order of
+  // IndexSpaceSizes().
+  std::vector<size_t> index_space_sizes_;
+  // Whether the input has a DataCount section, which the bodies that
+  // weren't materialized may rely on.
+  bool has_data_count_ = false;
+  std::vector<bool> materialized_;
+  Module module_;
+};
+
+}  // namespace wabt
+
+#endif /* WABT_LAZY_MODULE_H_ */
@@ -0,0 +1,288 @@
+#include "parallel-binary-writer.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "wabt/expr-visitor.h"
+#include "wabt/ir.h"
+#include "wabt/stream.h"
+
+#include "binary-cursor.h"
+#include "parallel.h"
+#include "section-reader.h"
+
+namespace wabt {
+
+namespace {
+
+// Fewer bodies than this aren't worth a second pass over the metadata.
+constexpr size_t kMinFuncsPerShard = 256;
+// Shards per worker, so a shard of large bodies doesn't hold up the rest.
+constexpr size_t kShardsPerWorker = 4;
+
+// The entries [begin, end) of a shard's code section.
+struct EncodedShard {
+  std::unique_ptr<OutputBuffer> buffer;
+  size_t begin = 0;
+  size_t end = 0;
+  bool done = false;
+  Result result = Result::Ok;
+};
+
+// Finds the instructions that make the writer keep the DataCount section.
+class DataSegmentUseFinder : public ExprVisitor::DelegateNop {
+ public:
+  bool found() const { return found_; }
+
+  // Implementation of ExprVisitor::DelegateNop.
+  Result OnMemoryInitExpr(MemoryInitExpr*) override {
+    found_ = true;
+    return Result::Ok;
+  }
+  Result OnDataDropExpr(DataDropExpr*) override {
+    found_ = true;
+    return Result::Ok;
+  }
+
+ private:
+  bool found_ = false;
+};
+
+// Whether a body of the defined functions [first, last) uses memory.init or
+// data.drop, for which the writer keeps the DataCount section.
+Result UsesDataSegments(const Module& module, Index first, Index last, bool* uses) {
+  DataSegmentUseFinder finder;
+  ExprVisitor visitor(&finder);
+  for (Index i = first; i < last && !finder.found(); ++i) {
+    CHECK_RESULT(visitor.VisitFunc(module.funcs[module.num_func_imports + i]));
+  }
+  *uses = finder.found();
+  return Result::Ok;
+}
+
+// |has_data_count| tells whether a DataCount section precedes the code
+// section.
+Result FindCodeSection(const uint8_t* data,
+                       size_t size,
+                       Errors* errors,
+                       SectionInfo* code,
+                       bool* has_data_count,
+                       std::vector<FunctionBody>* bodies) {
+  SectionReader reader("<output>", data, size, errors);
+  CHECK_RESULT(reader.ReadHeader());
+  *has_data_count = false;
+  while (reader.Next(code)) {
+    if (code->id == BinarySection::DataCount) {
+      *has_data_count = true;
+    } else if (code->id == BinarySection::Code) {
+      return ReadFunctionBodies(&reader, *code, bodies);
+    }
+  }
+  CHECK_RESULT(reader.result());
+  reader.Error(size, "no code section");
+  return Result::Error;
+}
+
+// Encodes the defined functions [first, last) by writing a module that
+// shares every index space with |module| but has only those bodies. The
+// other functions are stand-ins with an empty body, and the sections that
+// no body depends on are left out, so a shard costs a pass over the
+// declarations rather than over the whole module. Bodies refer to
+// everything by index, so the shell borrows no bindings; the data segments
+// are left out as well, so the shard has no DataCount section.
+void EncodeShard(const Module& module,
+                 const Func& stub,
+                 Index first,
+                 Index last,
+                 const WriteBinaryOptions& options,
+                 EncodedShard* shard) {
+  Module shell;
+  shell.types = module.types;
+  shell.imports = module.imports;
+  shell.funcs = module.funcs;
+  shell.tables = module.tables;
+  shell.memories = module.memories;
+  shell.globals = module.globals;
+  shell.tags = module.tags;
+  shell.num_func_imports = module.num_func_imports;
+  shell.num_table_imports = module.num_table_imports;
+  shell.num_memory_imports = module.num_memory_imports;
+  shell.num_global_imports = module.num_global_imports;
+  shell.num_tag_imports = module.num_tag_imports;
+  for (Index i = module.num_func_imports; i < shell.funcs.size(); ++i) {
+    Index func_index = i - module.num_func_imports;
+    if (func_index < first || func_index >= last) {
+      shell.funcs[i] = const_cast<Func*>(&stub);
+    }
+  }
+
+  WriteBinaryOptions shard_options = options;
+  shard_options.write_debug_names = false;
+  MemoryStream stream;
+  shard->result = WriteBinaryModule(&stream, &shell, shard_options);
+  // |shell| only borrows the fields of |module|; its own field list, the
+  // only thing it destroys, is empty.
+  if (Failed(shard->result)) {
+    return;
+  }
+  shard->buffer = stream.ReleaseOutputBuffer();
+
+  Errors errors;
+  SectionInfo code;
+  bool has_data_count;
+  std::vector<FunctionBody> bodies;
+  shard->result = FindCodeSection(shard->buffer->data.data(), shard->buffer->size(), &errors,
+                                  &code, &has_data_count, &bodies);
+  if (Succeeded(shard->result) && bodies.size() < last) {
+    shard->result = Result::Error;
+  }
+  if (Failed(shard->result)) {
+    return;
+  }
+  shard->begin = bodies[first].offset;
+  shard->end = bodies[last - 1].end;
+}
+
+void AppendSectionSize(std::vector<uint8_t>* out, uint32_t size, bool canonical) {
+  if (canonical) {
+    AppendU32Leb128(out, size);
+    return;
+  }
+  // The writer reserves five bytes for every size it fixes up afterwards.
+  for (int i = 0; i < 4; ++i) {
+    out->push_back(static_cast<uint8_t>((size & 0x7f) | 0x80));
+    size >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(size & 0x7f));
+}
+
+// Fixes up the padded size at |size_offset| of the section whose payload
+// starts at |payload_offset| and runs to the end of |stream|. A canonical
+// size is shorter than its padding, so the payload is moved back over the
+// rest of it, as the writer does.
+void FixupSectionSize(Stream* stream, size_t size_offset, size_t payload_offset, bool canonical) {
+  size_t payload_size = stream->offset() - payload_offset;
+  std::vector<uint8_t> size;
+  AppendSectionSize(&size, payload_size, canonical);
+  stream->WriteDataAt(size_offset, size.data(), size.size(), "section size");
+  if (size_offset + size.size() != payload_offset) {
+    stream->MoveData(size_offset + size.size(), payload_offset, payload_size);
+    stream->Truncate(size_offset + size.size() + payload_size);
+  }
+}
+
+}  // end anonymous namespace
+
+Result WriteBinaryModuleParallel(Stream* stream,
+                                 Module* module,
+                                 const WriteBinaryOptions& options,
+                                 unsigned num_threads) {
+  const size_t num_defined = module->funcs.size() - module->num_func_imports;
+  unsigned num_workers = NumWorkers(num_threads, num_defined / kMinFuncsPerShard);
+  // Code metadata is collected while bodies are written, and the shards'
+  // copies of it are dropped.
+  if (options.relocatable || options.features.annotations_enabled() || num_workers <= 1) {
+    return WriteBinaryModule(stream, module, options);
+  }
+
+  size_t num_shards = std::min(num_workers * kShardsPerWorker, num_defined / kMinFuncsPerShard);
+  auto shard_first = [&](size_t i) -> Index { return num_defined * i / num_shards; };
+
+  // The frame below has empty bodies, so the writer drops its DataCount
+  // section; it is put back if the real bodies need it.
+  bool uses_data_segments = false;
+  if (options.features.bulk_memory_enabled() && !module->data_segments.empty()) {
+    std::vector<uint8_t> uses(num_shards);
+    std::vector<Result> results(num_shards);
+    ParallelFor(num_shards, num_workers, [&](unsigned, size_t i) {
+      bool shard_uses = false;
+      results[i] = UsesDataSegments(*module, shard_first(i), shard_first(i + 1), &shard_uses);
+      uses[i] = shard_uses;
+    });
+    for (size_t i = 0; i < num_shards; ++i) {
+      CHECK_RESULT(results[i]);
+      uses_data_segments |= uses[i] != 0;
+    }
+  }
+
+  // Everything but the code section, with empty bodies. Written before the
+  // shards, which read the bodies it swaps out.
+  std::vector<ExprList> exprs(num_defined);
+  for (size_t i = 0; i < num_defined; ++i) {
+    std::swap(exprs[i], module->funcs[module->num_func_imports + i]->exprs);
+  }
+  MemoryStream frame;
+  Result result = WriteBinaryModule(&frame, module, options);
+  for (size_t i = 0; i < num_defined; ++i) {
+    std::swap(exprs[i], module->funcs[module->num_func_imports + i]->exprs);
+  }
+  CHECK_RESULT(result);
+
+  const OutputBuffer& buffer = frame.output_buffer();
+  const uint8_t* data = buffer.data.data();
+  Errors errors;
+  SectionInfo code;
+  bool has_data_count;
+  std::vector<FunctionBody> bodies;
+  CHECK_RESULT(FindCodeSection(data, buffer.size(), &errors, &code, &has_data_count, &bodies));
+
+  stream->WriteData(data, code.offset, "sections");
+  if (uses_data_segments && !has_data_count) {
+    const uint8_t id = static_cast<uint8_t>(BinarySection::DataCount);
+    std::vector<uint8_t> payload;
+    AppendU32Leb128(&payload, module->data_segments.size());
+    std::vector<uint8_t> size;
+    AppendSectionSize(&size, payload.size(), options.canonicalize_lebs);
+    stream->WriteU8(id, "section code");
+    stream->WriteData(size.data(), size.size(), "section size");
+    stream->WriteData(payload.data(), payload.size(), "data count");
+  }
+
+  // The code section size is only known once every shard is written, so it
+  // is padded for now and fixed up afterwards.
+  const uint8_t code_id = static_cast<uint8_t>(BinarySection::Code);
+  std::vector<uint8_t> padded_size;
+  AppendSectionSize(&padded_size, 0, false);
+  stream->WriteU8(code_id, "section code");
+  size_t size_offset = stream->offset();
+  stream->WriteData(padded_size.data(), padded_size.size(), "section size");
+  size_t payload_offset = stream->offset();
+  std::vector<uint8_t> count;
+  AppendU32Leb128(&count, num_defined);
+  stream->WriteData(count.data(), count.size(), "num functions");
+
+  // Each shard is written, and its buffer freed, as soon as it and the
+  // shards before it are encoded, so only the shards that finished out of
+  // order wait in memory.
+  std::vector<EncodedShard> shards(num_shards);
+  std::mutex write_mutex;
+  size_t next_to_write = 0;
+  Result write_result = Result::Ok;
+  Func stub("");
+  stub.decl.has_func_type = true;
+  stub.decl.type_var = Var(0, Location());
+  ParallelFor(num_shards, num_workers, [&](unsigned, size_t i) {
+    EncodeShard(*module, stub, shard_first(i), shard_first(i + 1), options, &shards[i]);
+    std::lock_guard<std::mutex> lock(write_mutex);
+    shards[i].done = true;
+    while (next_to_write < num_shards && shards[next_to_write].done) {
+      EncodedShard& shard = shards[next_to_write++];
+      write_result |= shard.result;
+      if (Succeeded(write_result)) {
+        stream->WriteData(shard.buffer->data.data() + shard.begin, shard.end - shard.begin,
+                          "function bodies");
+      }
+      shard.buffer.reset();
+    }
+  });
+  CHECK_RESULT(write_result);
+  FixupSectionSize(stream, size_offset, payload_offset, options.canonicalize_lebs);
+
+  stream->WriteData(data + code.end(), buffer.size() - code.end(), "sections");
+  return Result::Ok;
+}
+
+}  // namespace wabt
@@ -0,0 +1,32 @@
+#ifndef WABT_PARALLEL_BINARY_WRITER_H_
+#define WABT_PARALLEL_BINARY_WRITER_H_
+
+#include "wabt/binary-writer.h"
+#include "wabt/common.h"
+
+namespace wabt {
+
+struct Module;
+class Stream;
+
+// Writes the same bytes as WriteBinaryModule, encoding the function bodies
+// on up to |num_threads| threads; 0 means one per hardware thread. The
+// bodies are moved out of |module| and back while the other sections are
+// written, so nothing else may use it meanwhile. Every Var in the bodies
+// must be an index, as after reading a binary or ResolveNamesModule; pass a
+// |num_threads| of 1 for bodies that refer to anything by name. Relocatable
+// output, and output that may carry code metadata, is written serially.
+//
+// Bodies are written to |stream| in order as their shards are encoded, so
+// besides the shards that finished early only the other sections are held
+// in memory. The code section size is fixed up afterwards, and moved back
+// over its padding for canonical LEBs, so |stream| must support
+// WriteDataAt and MoveData, as FileOutputStream does.
+Result WriteBinaryModuleParallel(Stream* stream,
+                                 Module* module,
+                                 const WriteBinaryOptions& options,
+                                 unsigned num_threads);
+
+}  // namespace wabt
+
+#endif /* WABT_PARALLEL_BINARY_WRITER_H_ */
@@ -0,0 +1,159 @@
+#include "section-reader.h"
+
+#include <cstring>
+
+#include "binary-cursor.h"
+
+namespace wabt {
+
+SectionReader::SectionReader(const char* filename, const uint8_t* data, size_t size, Errors* errors)
+    : filename_(filename), data_(data), size_(size), errors_(errors) {}
+
+void SectionReader::Error(size_t offset, const std::string& message) {
+  errors_->emplace_back(ErrorLevel::Error, Location(filename_, offset), message);
+  result_ = Result::Error;
+}
+
+Result SectionReader::ReadHeader() {
+  const uint8_t kMagic[] = {0x00, 0x61, 0x73, 0x6d};
+  const uint8_t kVersion[] = {WABT_BINARY_VERSION, 0x00, 0x00, 0x00};
+  if (size_ < 8 || memcmp(data_, kMagic, 4) != 0) {
+    Error(0, "bad magic value");
+    return result_;
+  }
+  if (memcmp(data_ + 4, kVersion, 4) != 0) {
+    Error(4, "bad wasm file version");
+    return result_;
+  }
+  offset_ = 8;
+  return result_;
+}
+
+bool SectionReader::Next(SectionInfo* out) {
+  if (Failed(result_) || offset_ >= size_) {
+    return false;
+  }
+
+  BinaryCursor cursor(data_, size_, offset_);
+  uint8_t id;
+  uint32_t payload_size;
+  if (!cursor.ReadU8(&id) || !cursor.ReadU32Leb128(&payload_size)) {
+    Error(offset_, "unable to read section header");
+    return false;
+  }
+  if (payload_size > cursor.remaining()) {
+    Error(offset_, "invalid section size: extends past end");
+    return false;
+  }
+
+  out->id = static_cast<BinarySection>(id);
+  out->offset = offset_;
+  out->payload_offset = cursor.offset();
+  out->payload_size = payload_size;
+  offset_ = out->end();
+  return true;
+}
+
+Result ScanImports(const char* filename,
+                   const uint8_t* data,
+                   size_t size,
+                   Errors* errors,
+                   const std::function<bool(const ImportInfo&)>& callback) {
+  SectionReader reader(filename, data, size, errors);
+  CHECK_RESULT(reader.ReadHeader());
+
+  SectionInfo section;
+  while (reader.Next(&section)) {
+    if (section.id == BinarySection::Custom || section.id == BinarySection::Type) {
+      continue;
+    }
+    // Only custom and type sections may precede the import section.
+    if (section.id != BinarySection::Import) {
+      break;
+    }
+
+    BinaryCursor cursor(data, section.end(), section.payload_offset);
+    uint32_t count;
+    if (!cursor.ReadU32Leb128(&count)) {
+      reader.Error(cursor.offset(), "unable to read import count");
+      break;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      ImportInfo import;
+      import.offset = cursor.offset();
+      uint8_t kind;
+      if (!cursor.ReadString(&import.module_name) || !cursor.ReadString(&import.field_name)
+          || !cursor.ReadU8(&kind)) {
+        reader.Error(import.offset, "unable to read import entry");
+        return Result::Error;
+      }
+
+      bool ok = true;
+      uint8_t byte;
+      uint32_t index;
+      switch (kind) {
+        case 0x00:  // func: type index
+          ok = cursor.ReadU32Leb128(&index);
+          break;
+        case 0x01:  // table: element type, limits
+          ok = cursor.SkipValueType() && cursor.SkipLimits();
+          break;
+        case 0x02:  // memory: limits
+          ok = cursor.SkipLimits();
+          break;
+        case 0x03:  // global: value type, mutability
+          ok = cursor.SkipValueType() && cursor.ReadU8(&byte);
+          break;
+        case 0x04:  // tag: attribute, type index
+          ok = cursor.ReadU8(&byte) && cursor.ReadU32Leb128(&index);
+          break;
+        default:
+          reader.Error(import.offset, "malformed import kind: " + std::to_string(kind));
+          return Result::Error;
+      }
+      if (!ok) {
+        reader.Error(import.offset, "unable to read import descriptor");
+        return Result::Error;
+      }
+
+      import.kind = static_cast<ExternalKind>(kind);
+      if (!callback(import)) {
+        return Result::Ok;
+      }
+    }
+    break;
+  }
+  return reader.result();
+}
+
+Result ReadFunctionBodies(SectionReader* reader,
+                          const SectionInfo& section,
+                          std::vector<FunctionBody>* bodies) {
+  BinaryCursor cursor(reader->data(), section.end(), section.payload_offset);
+  uint32_t count;
+  if (!cursor.ReadU32Leb128(&count)) {
+    reader->Error(cursor.offset(), "unable to read function body count");
+    return Result::Error;
+  }
+  bodies->clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    FunctionBody body;
+    body.offset = cursor.offset();
+    uint32_t body_size;
+    if (!cursor.ReadU32Leb128(&body_size) || body_size > cursor.remaining()) {
+      reader->Error(body.offset, "unable to read function body size");
+      return Result::Error;
+    }
+    body.body_offset = cursor.offset();
+    cursor.Skip(body_size);
+    body.end = cursor.offset();
+    bodies->push_back(body);
+  }
+  if (!cursor.at_end()) {
+    reader->Error(cursor.offset(), "code section has trailing bytes");
+    return Result::Error;
+  }
+  return Result::Ok;
+}
+
+}  // namespace wabt
@@ -0,0 +1,87 @@
+#ifndef WABT_SECTION_READER_H_
+#define WABT_SECTION_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "wabt/binary.h"
+#include "wabt/common.h"
+#include "wabt/error.h"
+
+namespace wabt {
+
+struct SectionInfo {
+  BinarySection id;
+  // Offset of the section id byte.
+  size_t offset;
+  size_t payload_offset;
+  size_t payload_size;
+
+  size_t end() const { return payload_offset + payload_size; }
+};
+
+// Walks the sections of a binary module without decoding any of them.
+class SectionReader {
+ public:
+  SectionReader(const char* filename, const uint8_t* data, size_t size, Errors* errors);
+
+  // Checks the magic number and version. Must be called first.
+  Result ReadHeader();
+
+  // Reads the next section header. Returns false at the end of the module or
+  // when the framing is malformed, in which case result() is an error.
+  bool Next(SectionInfo* out);
+
+  Result result() const { return result_; }
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  void Error(size_t offset, const std::string& message);
+
+ private:
+  const char* filename_;
+  const uint8_t* data_;
+  size_t size_;
+  size_t offset_ = 0;
+  Errors* errors_;
+  Result result_ = Result::Ok;
+};
+
+struct ImportInfo {
+  std::string_view module_name;
+  std::string_view field_name;
+  ExternalKind kind;
+  // Offset of the import entry in the binary.
+  size_t offset;
+};
+
+// Calls |callback| for every import of the module, in order, after reading
+// only the section headers that precede the import section. Stops as soon as
+// |callback| returns false.
+Result ScanImports(const char* filename,
+                   const uint8_t* data,
+                   size_t size,
+                   Errors* errors,
+                   const std::function<bool(const ImportInfo&)>& callback);
+
+// One entry of the code section.
+struct FunctionBody {
+  // Offset of the body size.
+  size_t offset;
+  // Offset of the local declarations that follow the size.
+  size_t body_offset;
+  size_t end;
+};
+
+// Reads the framing of every entry of the code section |section|.
+Result ReadFunctionBodies(SectionReader* reader,
+                          const SectionInfo& section,
+                          std::vector<FunctionBody>* bodies);
+
+}  // namespace wabt
+
+#endif /* WABT_SECTION_READER_H_ */
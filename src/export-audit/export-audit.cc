@@ -14,12 +14,18 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cinttypes>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <string_view>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "wabt/apply-names.h"
 #include "wabt/binary-reader-ir.h"
@@ -35,11 +41,18 @@
 #include "wabt/validator.h"
 #include "wabt/wast-lexer.h"
 
+#include "arena.h"
+#include "batch-manifest.h"
+#include "export-rewriter.h"
+#include "file-output-stream.h"
+#include "lazy-module.h"
+#include "mapped-file.h"
+#include "parallel.h"
+
 using namespace wabt;
 
 static int s_verbose;
-static std::string s_infile;
-static std::string s_outfile;
+static std::vector<std::string> s_filenames;
 static Features s_features;
 static bool s_resolve_names = true;
 static bool s_read_debug_names = true;
@@ -49,6 +62,12 @@ static bool s_validate = true;
 static WriteBinaryOptions s_write_binary_options;
 static std::unordered_set<std::string> s_allowed_exports;
 static std::unordered_set<std::string> s_not_allowed_exports;
+static bool s_copy_sections = false;
+static bool s_lazy_bodies = false;
+static bool s_batch = false;
+static std::string s_manifest;
+static std::string s_output_dir;
+static unsigned s_num_threads = 0;
 
 static const char s_description[] = "XXX TBD";
 
@@ -81,13 +100,37 @@ static void ParseOptions( int argc, char** argv )
     s_fail_on_custom_section_error = false;
   } );
   parser.AddOption( "no-check", "Don't check for invalid modules", []() { s_validate = false; } );
-  parser.AddArgument( "filename", OptionParser::ArgumentCount::One, []( const char* argument ) {
-    s_infile = argument;
-    ConvertBackslashToSlash( &s_infile );
+  parser.AddOption( "copy-sections",
+                    "Copy every section except the export section byte-for-byte instead of re-encoding the module",
+                    []() { s_copy_sections = true; } );
+  parser.AddOption( "lazy-bodies",
+                    "Leave function bodies undecoded and write them back byte-for-byte. The module is not validated",
+                    []() { s_lazy_bodies = true; } );
+  parser.AddOption( "batch",
+                    "Treat every filename as an input and print one JSON result line per file to stdout",
+                    []() { s_batch = true; } );
+  parser.AddOption( "manifest",
+                    "FILENAME",
+                    "Also audit the files listed in FILENAME, one per line, optionally followed by an output "
+                    "filename and allow:EXPORT or deny:EXPORT entries replacing -e/-r for that file. Implies --batch",
+                    []( const char* argument ) {
+                      s_manifest = argument;
+                      s_batch = true;
+                    } );
+  parser.AddOption( "output-dir",
+                    "DIR",
+                    "Directory for the outputs of --batch inputs that don't name one, each named by the input's basename; inputs sharing one are errors",
+                    []( const char* argument ) {
+                      s_output_dir = argument;
+                      ConvertBackslashToSlash( &s_output_dir );
+                    } );
+  parser.AddOption( 'j', "jobs", "N", "Number of threads used by --batch", []( const char* argument ) {
+    s_num_threads = std::max( 1, atoi( argument ) );
   } );
-  parser.AddArgument( "output", OptionParser::ArgumentCount::One, []( const char* argument ) {
-    s_outfile = argument;
-    ConvertBackslashToSlash( &s_outfile );
+  // "filename output", or only inputs with --batch.
+  parser.AddArgument( "filename", OptionParser::ArgumentCount::ZeroOrMore, []( const char* argument ) {
+    s_filenames.push_back( argument );
+    ConvertBackslashToSlash( &s_filenames.back() );
   } );
   parser.Parse( argc, argv );
 }
@@ -97,10 +140,209 @@ std::string StripWasm( const std::string& file_name )
   return file_name.substr( 0, file_name.length() - 5 );
 }
 
-int ProgramMain( int argc, char** argv )
+struct ExportPolicy
+{
+  std::unordered_set<std::string> allowed;
+  std::unordered_set<std::string> not_allowed;
+};
+
+struct AuditOutcome
+{
+  Result result = Result::Ok;
+  Index kept = 0;
+  Index removed = 0;
+  Errors errors;
+};
+
+// Returns whether the export |name| is retained. With |print|, reports the
+// decision on stderr.
+static bool KeepExport( std::string_view name, const ExportPolicy& policy, bool print )
+{
+  bool keep = true;
+  if ( policy.allowed.size() > 0 ) {
+    keep = policy.allowed.count( std::string( name ) );
+  } else if ( policy.not_allowed.size() > 0 ) {
+    keep = !policy.not_allowed.count( std::string( name ) );
+  }
+  if ( print ) {
+    std::cerr << "found export \"" << name << "\" " << ( keep ? "\n" : "(suppressing)\n" );
+  }
+  return keep;
+}
+
+static Result WriteOutput( const std::string& outfile, const std::function<Result( Stream* )>& write )
+{
+  FileOutputStream stream;
+  Result result = stream.Open( outfile );
+  if ( Succeeded( result ) ) {
+    result = write( &stream );
+    result |= stream.Close();
+    if ( Failed( result ) ) {
+      std::remove( outfile.c_str() );
+    }
+  }
+  return result;
+}
+
+// Only touches |outcome| and |outfile|, so files can be audited concurrently.
+static void AuditFile( const std::string& infile,
+                       const std::string& outfile,
+                       const ExportPolicy& policy,
+                       bool print,
+                       AuditOutcome* outcome )
+{
+  MappedFile file;
+  Result result = file.Open( infile );
+  if ( Failed( result ) ) {
+    outcome->result = result;
+    return;
+  }
+
+  auto keep = [&]( std::string_view name ) {
+    bool kept = KeepExport( name, policy, print );
+    ( kept ? outcome->kept : outcome->removed )++;
+    return kept;
+  };
+
+  Errors* errors = &outcome->errors;
+  Module module;
+  LazyModule lazy;
+  Module* ir = &module;
+  const bool lazy_bodies = s_lazy_bodies && !s_copy_sections;
+  const bool kStopOnFirstError = true;
+  ReadBinaryOptions options(
+    s_features, s_log_stream.get(), s_read_debug_names, kStopOnFirstError, s_fail_on_custom_section_error );
+  file.AdviseSequential();
+  if ( lazy_bodies ) {
+    // Without the bodies there is nothing to validate them against.
+    result = lazy.Read( infile.c_str(), file.data(), file.size(), options, errors );
+    ir = lazy.module();
+  } else if ( !s_copy_sections || s_validate ) {
+    result = ReadBinaryIr( infile.c_str(), file.data(), file.size(), options, errors, &module );
+    if ( Succeeded( result ) && s_validate ) {
+      ValidateOptions options( s_features );
+      result = ValidateModule( &module, errors, options );
+    }
+  }
+
+  if ( Succeeded( result ) && s_copy_sections ) {
+    result = WriteOutput( outfile, [&]( Stream* stream ) {
+      return RewriteExports( infile.c_str(), file.data(), file.size(), errors, keep, stream );
+    } );
+  } else if ( Succeeded( result ) ) {
+    // A lazy module copies its bodies from the mapping when it is written.
+    if ( !lazy_bodies ) {
+      file.Release();
+    }
+    for ( auto it = ir->exports.begin(); it != ir->exports.end(); ) {
+      if ( keep( ( *it )->name ) ) {
+        ++it;
+      } else {
+        it = ir->exports.erase( it );
+      }
+    }
+    result = WriteOutput( outfile, [&]( Stream* stream ) {
+      if ( lazy_bodies ) {
+        return lazy.Write( stream, s_write_binary_options, errors );
+      }
+      return WriteBinaryModule( stream, &module, s_write_binary_options );
+    } );
+  }
+  outcome->result = result;
+}
+
+static std::string ResultLine( const BatchEntry& entry, const AuditOutcome& outcome )
+{
+  std::string line = "{\"file\":" + JsonString( entry.filename ) + ",\"output\":" + JsonString( entry.output );
+  if ( Failed( outcome.result ) ) {
+    line += ",\"status\":\"error\"";
+    if ( !outcome.errors.empty() ) {
+      line += ",\"message\":" + JsonString( outcome.errors.front().message );
+    }
+  } else {
+    line += ",\"status\":\"ok\",\"kept\":" + std::to_string( outcome.kept )
+            + ",\"removed\":" + std::to_string( outcome.removed );
+  }
+  return line + "}\n";
+}
+
+static std::string BatchOutput( const std::string& infile )
 {
-  Result result;
+  if ( s_output_dir.empty() ) {
+    return {};
+  }
+  size_t slash = infile.find_last_of( '/' );
+  return s_output_dir + "/" + ( slash == std::string::npos ? infile : infile.substr( slash + 1 ) );
+}
+
+static int BatchMain()
+{
+  std::vector<BatchEntry> entries;
+  for ( const auto& filename : s_filenames ) {
+    entries.push_back( BatchEntry { filename, {}, {}, {} } );
+  }
+  if ( !s_manifest.empty() && Failed( ReadBatchManifest( s_manifest, &entries ) ) ) {
+    return 1;
+  }
+  for ( auto& entry : entries ) {
+    if ( entry.output.empty() ) {
+      entry.output = BatchOutput( entry.filename );
+    }
+  }
+  // Inputs in different directories can share a basename, and audits writing
+  // the same output would race.
+  std::unordered_map<std::string, size_t> first_with_output;
+  std::vector<size_t> same_output_as( entries.size(), SIZE_MAX );
+  for ( size_t i = 0; i < entries.size(); ++i ) {
+    if ( entries[i].output.empty() ) {
+      continue;
+    }
+    auto [iter, inserted] = first_with_output.emplace( entries[i].output, i );
+    if ( !inserted ) {
+      same_output_as[i] = iter->second;
+    }
+  }
+
+  const ExportPolicy default_policy { s_allowed_exports, s_not_allowed_exports };
+  std::vector<AuditOutcome> outcomes( entries.size() );
+  unsigned num_threads = s_log_stream ? 1 : s_num_threads;
+  ParallelFor( entries.size(), num_threads, [&]( unsigned, size_t i ) {
+    const BatchEntry& entry = entries[i];
+    AuditOutcome* outcome = &outcomes[i];
+    if ( entry.output.empty() ) {
+      outcome->result = Result::Error;
+      outcome->errors.emplace_back( ErrorLevel::Error, Location(), "no output filename, use --output-dir" );
+    } else if ( same_output_as[i] != SIZE_MAX ) {
+      outcome->result = Result::Error;
+      outcome->errors.emplace_back( ErrorLevel::Error,
+                                    Location(),
+                                    "output " + entry.output + " is also the output of "
+                                      + entries[same_output_as[i]].filename );
+    } else if ( !entry.allowed.empty() && !entry.denied.empty() ) {
+      outcome->result = Result::Error;
+      outcome->errors.emplace_back( ErrorLevel::Error, Location(), "specifying allow and deny at the same time" );
+    } else if ( entry.allowed.empty() && entry.denied.empty() ) {
+      AuditFile( entry.filename, entry.output, default_policy, false, outcome );
+    } else {
+      ExportPolicy policy { { entry.allowed.begin(), entry.allowed.end() },
+                            { entry.denied.begin(), entry.denied.end() } };
+      AuditFile( entry.filename, entry.output, policy, false, outcome );
+    }
+  } );
 
+  // Printed in input order once everything is audited, so the output is the
+  // same for any number of threads.
+  bool failed = false;
+  for ( size_t i = 0; i < entries.size(); ++i ) {
+    std::cout << ResultLine( entries[i], outcomes[i] );
+    failed |= Failed( outcomes[i].result );
+  }
+  std::cout.flush();
+  return failed;
+}
+
+int ProgramMain( int argc, char** argv )
+{
   InitStdio();
   ParseOptions( argc, argv );
   
@@ -108,61 +350,25 @@ int ProgramMain( int argc, char** argv )
     std::cerr << "Specifying -e and -r at the same time\n";
     return 1;
   }
+  s_write_binary_options.features = s_features;
 
-  std::vector<uint8_t> file_data;
-  result = ReadFile( s_infile.c_str(), &file_data );
-
-  if ( Succeeded( result ) ) {
-    Errors errors;
-    Module module;
-    const bool kStopOnFirstError = true;
-    ReadBinaryOptions options(
-      s_features, s_log_stream.get(), s_read_debug_names, kStopOnFirstError, s_fail_on_custom_section_error );
-    result = ReadBinaryIr( s_infile.c_str(), file_data.data(), file_data.size(), options, &errors, &module );
-    if ( Succeeded( result ) ) {
-      if ( s_validate ) {
-        ValidateOptions options( s_features );
-        result = ValidateModule( &module, &errors, options );
-      }
-
-      for ( auto it = module.exports.begin(); it != module.exports.end(); ) {
-        std::cerr << "found export \"" << ( *it )->name << "\" ";
-
-        const auto& name = ( *it )->name;
-        
-        if ( s_allowed_exports.size() > 0 ) {
-          if ( s_allowed_exports.count( name ) ) {
-            std::cerr << "\n";
-            ++it;
-          } else {
-            std::cerr << "(suppressing)\n";
-            it = module.exports.erase( it );
-          }
-        } else if ( s_not_allowed_exports.size() > 0 ) {
-          if ( s_not_allowed_exports.count( name ) ) {
-            std::cerr << "(suppressing)\n";
-            it = module.exports.erase( it );
-          } else {
-            std::cerr << "\n";
-            ++it;
-          }
-        }
-      }
-
-      MemoryStream memory_stream;
-      if ( Succeeded( result ) ) {
-        // have to serialize to MemoryStream because FileStream::Truncate is not implemented
-        s_write_binary_options.features = s_features;
-        result = WriteBinaryModule( &memory_stream, &module, s_write_binary_options );
-      }
+  if ( s_batch ) {
+    return BatchMain();
+  }
 
-      if ( Succeeded( result ) ) {
-        memory_stream.WriteToFile( s_outfile );
-      }
-    }
-    FormatErrorsToFile( errors, Location::Type::Binary );
+  if ( s_filenames.size() != 2 ) {
+    std::cerr << "Expected an input and an output filename, use --batch to audit several inputs\n";
+    return 1;
   }
-  return result != Result::Ok;
+
+  // A single audit builds one module and exits; a batch frees each module
+  // before the next one, which the arena wouldn't reuse.
+  EnableArena();
+  const ExportPolicy policy { s_allowed_exports, s_not_allowed_exports };
+  AuditOutcome outcome;
+  AuditFile( s_filenames[0], s_filenames[1], policy, true, &outcome );
+  FormatErrorsToFile( outcome.errors, Location::Type::Binary );
+  FastExit( outcome.result != Result::Ok );
 }
 
 int main( int argc, char** argv )
@@ -14,12 +14,15 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <string_view>
 #include <unordered_set>
+#include <vector>
 
 #include "wabt/apply-names.h"
 #include "wabt/binary-reader-ir.h"
@@ -35,10 +38,15 @@
 #include "wabt/validator.h"
 #include "wabt/wast-lexer.h"
 
+#include "batch-manifest.h"
+#include "mapped-file.h"
+#include "parallel.h"
+#include "section-reader.h"
+
 using namespace wabt;
 
 static int s_verbose;
-static std::string s_infile;
+static std::vector<std::string> s_infiles;
 static std::string s_outfile;
 static Features s_features;
 static bool s_read_debug_names = true;
@@ -46,6 +54,10 @@ static bool s_fail_on_custom_section_error = true;
 static std::unique_ptr<FileStream> s_log_stream;
 static std::unordered_set<std::string> s_allowed_import_modules;
 static std::unordered_set<std::string> s_not_allowed_import_modules;
+static bool s_full_decode = false;
+static bool s_batch = false;
+static std::string s_manifest;
+static unsigned s_num_threads = 0;
 
 static const char s_description[] = "XXX TBD";
 
@@ -73,12 +85,29 @@ static void ParseOptions( int argc, char** argv )
 
   parser.AddOption(
     "no-debug-names", "Ignore debug names in the binary file", []() { s_read_debug_names = false; } );
+  parser.AddOption( "full-decode",
+                    "Read the whole module into IR instead of scanning only the import section",
+                    []() { s_full_decode = true; } );
   parser.AddOption( "ignore-custom-section-errors", "Ignore errors in custom sections", []() {
     s_fail_on_custom_section_error = false;
   } );
-  parser.AddArgument( "filename", OptionParser::ArgumentCount::One, []( const char* argument ) {
-    s_infile = argument;
-    ConvertBackslashToSlash( &s_infile );
+  parser.AddOption( "batch",
+                    "Check every filename and print one JSON result line per file to stdout",
+                    []() { s_batch = true; } );
+  parser.AddOption( "manifest",
+                    "FILENAME",
+                    "Also check the files listed in FILENAME, one per line, optionally followed by "
+                    "allow:MODULE or deny:MODULE entries replacing -i/-e for that file. Implies --batch",
+                    []( const char* argument ) {
+                      s_manifest = argument;
+                      s_batch = true;
+                    } );
+  parser.AddOption( 'j', "jobs", "N", "Number of threads used by --batch", []( const char* argument ) {
+    s_num_threads = std::max( 1, atoi( argument ) );
+  } );
+  parser.AddArgument( "filename", OptionParser::ArgumentCount::ZeroOrMore, []( const char* argument ) {
+    s_infiles.push_back( argument );
+    ConvertBackslashToSlash( &s_infiles.back() );
   } );
   parser.Parse( argc, argv );
 }
@@ -88,48 +117,177 @@ std::string StripWasm( const std::string& file_name )
   return file_name.substr( 0, file_name.length() - 5 );
 }
 
-int ProgramMain( int argc, char** argv )
+struct ImportPolicy
 {
-  Result result;
+  std::unordered_set<std::string> allowed;
+  std::unordered_set<std::string> not_allowed;
+};
 
-  InitStdio();
-  ParseOptions( argc, argv );
-  
-  if ( s_allowed_import_modules.size() > 0 && s_not_allowed_import_modules.size() > 0 ) {
-    std::cerr << "Specifying -i and -e at the same time\n";
-    return 1;
+struct CheckOutcome
+{
+  Result result = Result::Ok;
+  bool allowed = true;
+  // The first module the file is not allowed to import from.
+  std::string denied_module;
+  Errors errors;
+};
+
+// Returns false if importing from |import_module_name| is not allowed. With
+// |print|, reports every import module and the violation on stderr.
+static bool CheckImportModule( std::string_view import_module_name, const ImportPolicy& policy, bool print )
+{
+  if ( print ) {
+    std::cerr << "Import from module: " << import_module_name << "\n";
+  }
+
+  if ( policy.allowed.size() > 0 ) {
+    if ( !policy.allowed.count( std::string( import_module_name ) ) ) {
+      if ( print ) {
+        std::cerr << "Find import module not in allowed list\n";
+      }
+      return false;
+    }
+  } else if ( policy.not_allowed.size() > 0 ) {
+    if ( policy.not_allowed.count( std::string( import_module_name ) ) ) {
+      if ( print ) {
+        std::cerr << "Find not allowed import\n";
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+// Only touches |outcome|, so files can be checked concurrently.
+static void CheckFile( const std::string& filename, const ImportPolicy& policy, bool print, CheckOutcome* outcome )
+{
+  MappedFile file;
+  outcome->result = file.Open( filename );
+  if ( Failed( outcome->result ) ) {
+    return;
   }
 
-  std::vector<uint8_t> file_data;
-  result = ReadFile( s_infile.c_str(), &file_data );
+  auto check = [&]( std::string_view import_module_name ) {
+    if ( !CheckImportModule( import_module_name, policy, print ) ) {
+      outcome->allowed = false;
+      outcome->denied_module = import_module_name;
+    }
+    return outcome->allowed;
+  };
 
-  if ( Succeeded( result ) ) {
-    Errors errors;
+  file.AdviseSequential();
+  if ( s_full_decode ) {
     Module module;
     const bool kStopOnFirstError = true;
     ReadBinaryOptions options(
       s_features, s_log_stream.get(), s_read_debug_names, kStopOnFirstError, s_fail_on_custom_section_error );
-    result = ReadBinaryIr( s_infile.c_str(), file_data.data(), file_data.size(), options, &errors, &module );
-    if ( Succeeded( result ) ) {
+    outcome->result = ReadBinaryIr( filename.c_str(), file.data(), file.size(), options, &outcome->errors, &module );
+    if ( Succeeded( outcome->result ) ) {
       for ( const auto& import_ : module.imports ) {
-        const auto& import_module_name = import_->module_name;
-        std::cerr << "Import from module: " << import_module_name << "\n";
-
-        if ( s_allowed_import_modules.size() > 0 ) {
-          if ( !s_allowed_import_modules.count( import_module_name ) ) {
-            std::cerr << "Find import module not in allowed list\n";
-            return 1;
-          }
-        } else if ( s_not_allowed_import_modules.size() > 0 ) {
-          if ( s_not_allowed_import_modules.count( import_module_name ) ) {
-            std::cerr << "Find not allowed import\n";
-            return 1;
-          }
+        if ( !check( import_->module_name ) ) {
+          break;
         }
       }
     }
+  } else {
+    // Only the section headers in front of the import section are read, and
+    // the scan stops at the first violation.
+    outcome->result = ScanImports( filename.c_str(),
+                                   file.data(),
+                                   file.size(),
+                                   &outcome->errors,
+                                   [&]( const ImportInfo& import_ ) { return check( import_.module_name ); } );
+  }
+}
+
+static std::string ResultLine( const std::string& filename, const CheckOutcome& outcome )
+{
+  std::string line = "{\"file\":" + JsonString( filename );
+  if ( Failed( outcome.result ) ) {
+    line += ",\"status\":\"error\"";
+    if ( !outcome.errors.empty() ) {
+      line += ",\"message\":" + JsonString( outcome.errors.front().message );
+    }
+  } else if ( !outcome.allowed ) {
+    line += ",\"status\":\"denied\",\"module\":" + JsonString( outcome.denied_module );
+  } else {
+    line += ",\"status\":\"allowed\"";
+  }
+  return line + "}\n";
+}
+
+static int BatchMain()
+{
+  std::vector<BatchEntry> entries;
+  for ( const auto& infile : s_infiles ) {
+    entries.push_back( BatchEntry { infile, {}, {}, {} } );
+  }
+  if ( !s_manifest.empty() && Failed( ReadBatchManifest( s_manifest, &entries ) ) ) {
+    return 1;
+  }
+
+  const ImportPolicy default_policy { s_allowed_import_modules, s_not_allowed_import_modules };
+  std::vector<CheckOutcome> outcomes( entries.size() );
+  unsigned num_threads = s_log_stream ? 1 : s_num_threads;
+  ParallelFor( entries.size(), num_threads, [&]( unsigned, size_t i ) {
+    const BatchEntry& entry = entries[i];
+    if ( !entry.output.empty() ) {
+      outcomes[i].result = Result::Error;
+      outcomes[i].errors.emplace_back(
+        ErrorLevel::Error, Location(), "unexpected output filename \"" + entry.output + "\", import-check writes none" );
+      return;
+    }
+    if ( entry.allowed.empty() && entry.denied.empty() ) {
+      CheckFile( entry.filename, default_policy, false, &outcomes[i] );
+      return;
+    }
+    if ( !entry.allowed.empty() && !entry.denied.empty() ) {
+      outcomes[i].result = Result::Error;
+      outcomes[i].errors.emplace_back( ErrorLevel::Error, Location(), "specifying allow and deny at the same time" );
+      return;
+    }
+    ImportPolicy policy { { entry.allowed.begin(), entry.allowed.end() }, { entry.denied.begin(), entry.denied.end() } };
+    CheckFile( entry.filename, policy, false, &outcomes[i] );
+  } );
+
+  // Printed in input order once everything is checked, so the output is the
+  // same for any number of threads.
+  bool failed = false;
+  for ( size_t i = 0; i < entries.size(); ++i ) {
+    std::cout << ResultLine( entries[i].filename, outcomes[i] );
+    failed |= Failed( outcomes[i].result ) || !outcomes[i].allowed;
+  }
+  std::cout.flush();
+  return failed;
+}
+
+int ProgramMain( int argc, char** argv )
+{
+  InitStdio();
+  ParseOptions( argc, argv );
+  
+  if ( s_allowed_import_modules.size() > 0 && s_not_allowed_import_modules.size() > 0 ) {
+    std::cerr << "Specifying -i and -e at the same time\n";
+    return 1;
+  }
+
+  if ( s_batch ) {
+    return BatchMain();
+  }
+
+  if ( s_infiles.size() != 1 ) {
+    std::cerr << "Expected exactly one filename, use --batch to check several\n";
+    return 1;
+  }
+
+  const ImportPolicy policy { s_allowed_import_modules, s_not_allowed_import_modules };
+  CheckOutcome outcome;
+  CheckFile( s_infiles.front(), policy, true, &outcome );
+  if ( !outcome.allowed ) {
+    return 1;
   }
-  return result != Result::Ok;
+  FormatErrorsToFile( outcome.errors, Location::Type::Binary );
+  return outcome.result != Result::Ok;
 }
 
 int main( int argc, char** argv )
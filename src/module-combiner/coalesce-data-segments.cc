@@ -0,0 +1,250 @@
+#include "coalesce-data-segments.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "wabt/cast.h"
+#include "wabt/expr-visitor.h"
+#include "wabt/ir.h"
+
+#include "remap-indices.h"
+
+namespace wabt {
+
+namespace {
+
+// A segment costs a flags byte, an i32.const offset expression and a size on
+// top of its bytes, so shorter runs of zeros aren't worth splitting out.
+constexpr size_t kMinZeroRun = 16;
+
+// Marks the data segments that instructions refer to.
+class SegmentUseScanner : public ExprVisitor::DelegateNop {
+ public:
+  SegmentUseScanner(Module* module, std::vector<bool>* used)
+      : module_(module), used_(used), visitor_(this) {}
+
+  Result VisitModule() {
+    for (Func* func : module_->funcs) {
+      CHECK_RESULT(visitor_.VisitFunc(func));
+    }
+    return Result::Ok;
+  }
+
+  // Implementation of ExprVisitor::DelegateNop.
+  Result OnMemoryInitExpr(MemoryInitExpr* expr) override { return Use(expr->var); }
+  Result OnDataDropExpr(DataDropExpr* expr) override { return Use(expr->var); }
+
+ private:
+  Result Use(const Var& var) {
+    Index index = module_->GetDataSegmentIndex(var);
+    if (index < used_->size()) {
+      (*used_)[index] = true;
+    }
+    return Result::Ok;
+  }
+
+  Module* module_;
+  std::vector<bool>* used_;
+  ExprVisitor visitor_;
+};
+
+bool GetConstOffset(const ExprList& offset, uint32_t* value) {
+  if (offset.size() != 1 || offset.front().type() != ExprType::Const) {
+    return false;
+  }
+  const Const& const_ = cast<ConstExpr>(&offset.front())->const_;
+  if (const_.type() != Type::I32) {
+    return false;
+  }
+  *value = const_.u32();
+  return true;
+}
+
+struct Segment {
+  Index index;
+  uint64_t begin;
+  uint64_t end;
+};
+
+// Bytes to write at |offset|.
+struct Piece {
+  uint64_t offset;
+  std::vector<uint8_t> data;
+};
+
+// Cuts the zeros out of |piece| into |pieces|.
+void SplitZeros(const Piece& piece, std::vector<Piece>* pieces) {
+  const std::vector<uint8_t>& data = piece.data;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    while (pos < data.size() && data[pos] == 0) {
+      ++pos;
+    }
+    if (pos == data.size()) {
+      break;
+    }
+    size_t start = pos;
+    size_t end = pos;
+    // Extend over runs of zeros too short to split out.
+    while (pos < data.size()) {
+      if (data[pos] != 0) {
+        end = ++pos;
+        continue;
+      }
+      size_t zeros = pos;
+      while (pos < data.size() && data[pos] == 0) {
+        ++pos;
+      }
+      if (pos == data.size() || pos - zeros >= kMinZeroRun) {
+        break;
+      }
+    }
+    pieces->push_back(Piece{piece.offset + start,
+                            std::vector<uint8_t>(data.begin() + start, data.begin() + end)});
+  }
+}
+
+// Sorts the active segments |segments| of |memory| by offset. Returns
+// whether they are all in bounds and none overlap, so that every byte they
+// don't write stays zero.
+bool SortDisjoint(const Memory* memory, std::vector<Segment>* segments) {
+  std::sort(segments->begin(), segments->end(),
+            [](const Segment& a, const Segment& b) { return a.begin < b.begin; });
+  const uint64_t size = memory->page_limits.initial * WABT_PAGE_SIZE;
+  for (size_t i = 0; i < segments->size(); ++i) {
+    if ((*segments)[i].end > size || (i > 0 && (*segments)[i].begin < (*segments)[i - 1].end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Appends the pieces the sorted, disjoint |segments| come down to.
+void Coalesce(const Module* module, const std::vector<Segment>& segments, std::vector<Piece>* pieces) {
+  Piece current{0, {}};
+  bool open = false;
+  for (const Segment& segment : segments) {
+    const std::vector<uint8_t>& data = module->data_segments[segment.index]->data;
+    if (open && segment.begin != current.offset + current.data.size()) {
+      SplitZeros(current, pieces);
+      open = false;
+    }
+    if (!open) {
+      current.offset = segment.begin;
+      current.data.clear();
+      open = true;
+    }
+    current.data.insert(current.data.end(), data.begin(), data.end());
+  }
+  if (open) {
+    SplitZeros(current, pieces);
+  }
+}
+
+void SetOffset(DataSegment* segment, uint64_t offset) {
+  cast<ConstExpr>(&segment->offset.front())->const_ = Const::I32(static_cast<uint32_t>(offset));
+}
+
+}  // end anonymous namespace
+
+Result CoalesceDataSegments(Module* module) {
+  const Index num_segments = module->data_segments.size();
+  std::vector<bool> used(num_segments);
+  SegmentUseScanner scanner(module, &used);
+  CHECK_RESULT(scanner.VisitModule());
+
+  // The active segments of every memory, and whether they may be rewritten.
+  std::vector<std::vector<Segment>> memory_segments(module->memories.size());
+  std::vector<bool> eligible(module->memories.size(), true);
+  for (Index i = 0; i < module->num_memory_imports; ++i) {
+    eligible[i] = false;
+  }
+  for (Index i = 0; i < module->memories.size(); ++i) {
+    if (module->memories[i]->page_limits.is_64) {
+      eligible[i] = false;
+    }
+  }
+  for (Index i = 0; i < num_segments; ++i) {
+    const DataSegment* segment = module->data_segments[i];
+    if (segment->kind != SegmentKind::Active) {
+      continue;
+    }
+    Index memory_index = module->GetMemoryIndex(segment->memory_var);
+    if (memory_index >= eligible.size()) {
+      continue;
+    }
+    uint32_t offset;
+    if (!GetConstOffset(segment->offset, &offset)) {
+      eligible[memory_index] = false;
+      continue;
+    }
+    // Segments that stay as they are still count for overlaps.
+    memory_segments[memory_index].push_back(
+        Segment{i, offset, uint64_t(offset) + segment->data.size()});
+  }
+
+  ModuleIndexMap map;
+  map.data_segments.resize(num_segments);
+  for (Index i = 0; i < num_segments; ++i) {
+    map.data_segments[i] = i;
+  }
+  bool dropped = false;
+  for (Index m = 0; m < module->memories.size(); ++m) {
+    std::vector<Segment>& segments = memory_segments[m];
+    if (!eligible[m] || !SortDisjoint(module->memories[m], &segments)) {
+      continue;
+    }
+    std::vector<Segment> rewritten;
+    std::vector<Index> slots;
+    for (const Segment& segment : segments) {
+      if (!used[segment.index]) {
+        rewritten.push_back(segment);
+        slots.push_back(segment.index);
+      }
+    }
+    std::vector<Piece> pieces;
+    Coalesce(module, rewritten, &pieces);
+
+    // Reuse the slots of the old segments in order, then append new ones.
+    std::sort(slots.begin(), slots.end());
+    size_t next = 0;
+    for (Piece& piece : pieces) {
+      if (next < slots.size()) {
+        DataSegment* segment = module->data_segments[slots[next++]];
+        SetOffset(segment, piece.offset);
+        segment->data = std::move(piece.data);
+        continue;
+      }
+      auto field = std::make_unique<DataSegmentModuleField>();
+      DataSegment& segment = field->data_segment;
+      segment.kind = SegmentKind::Active;
+      segment.memory_var = Var(m, Location());
+      segment.offset.push_back(std::make_unique<ConstExpr>(Const::I32(static_cast<uint32_t>(piece.offset))));
+      segment.data = std::move(piece.data);
+      module->AppendField(std::move(field));
+    }
+    for (; next < slots.size(); ++next) {
+      map.data_segments[slots[next]] = kInvalidIndex;
+      dropped = true;
+    }
+  }
+
+  if (!dropped) {
+    return Result::Ok;
+  }
+  // Appended segments keep their index relative to each other.
+  for (Index i = num_segments; i < module->data_segments.size(); ++i) {
+    map.data_segments.push_back(i);
+  }
+  Index next = 0;
+  for (Index& index : map.data_segments) {
+    if (index != kInvalidIndex) {
+      index = next++;
+    }
+  }
+  return ApplyIndexMap(module, map);
+}
+
+}  // namespace wabt
@@ -0,0 +1,21 @@
+#ifndef WABT_COALESCE_DATA_SEGMENTS_H_
+#define WABT_COALESCE_DATA_SEGMENTS_H_
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+struct Module;
+
+// Rewrites the active data segments of every defined 32-bit memory of
+// |module| into as few segments as possible that don't write zeros: segments
+// that are contiguous are merged, zeros at either end of a segment are
+// dropped and long runs of zeros inside one split it in two. A memory is
+// left alone if any of its segments have a non-constant offset, overlap or
+// go past its initial size, since then the bytes they leave zero aren't
+// known. Segments named by memory.init or data.drop are kept as they are.
+Result CoalesceDataSegments(struct Module*);
+
+}  // namespace wabt
+
+#endif /* WABT_COALESCE_DATA_SEGMENTS_H_ */
@@ -3,50 +3,174 @@
 #include <map>
 #include <memory>
 #include <string>
-#include <iostream> 
+#include <iostream>
 
 #include "wabt/cast.h"
 #include "wabt/expr-visitor.h"
 #include "wabt/ir.h"
 
+#include "remap-indices.h"
+#include "resolve-imports.h"
+
 namespace wabt {
 
-Result CombineModules(Module* module, Module* libmodule, Module* result) {
-  ModuleFieldList temp_module;
-  ModuleFieldList temp_libmodule;
-
-  // Append imports of module excluding imports from libmodule 
-  while (!module->fields.empty()) {
-    const ModuleField* field = &module->fields.front();
-    if (field->type() == ModuleFieldType::Import) {
-      auto field_uniq_ptr = cast<ImportModuleField>(std::move(module->fields.extract_front())); 
-      if (field_uniq_ptr->import->module_name != libmodule->name) {
-        result->AppendField(std::move(field_uniq_ptr));
+namespace {
+
+Index NumImports(const Module* module, ExternalKind kind) {
+  switch (kind) {
+    case ExternalKind::Func:
+      return module->num_func_imports;
+    case ExternalKind::Table:
+      return module->num_table_imports;
+    case ExternalKind::Memory:
+      return module->num_memory_imports;
+    case ExternalKind::Global:
+      return module->num_global_imports;
+    case ExternalKind::Tag:
+      return module->num_tag_imports;
+  }
+  return 0;
+}
+
+Index NumEntities(const Module* module, ExternalKind kind) {
+  switch (kind) {
+    case ExternalKind::Func:
+      return module->funcs.size();
+    case ExternalKind::Table:
+      return module->tables.size();
+    case ExternalKind::Memory:
+      return module->memories.size();
+    case ExternalKind::Global:
+      return module->globals.size();
+    case ExternalKind::Tag:
+      return module->tags.size();
+  }
+  return 0;
+}
+
+std::vector<Index>& GetMap(ModuleIndexMap* map, ExternalKind kind) {
+  switch (kind) {
+    case ExternalKind::Func:
+      return map->funcs;
+    case ExternalKind::Table:
+      return map->tables;
+    case ExternalKind::Memory:
+      return map->memories;
+    case ExternalKind::Global:
+      return map->globals;
+    case ExternalKind::Tag:
+      return map->tags;
+  }
+  WABT_UNREACHABLE;
+}
+
+// Lays out one index space the way CombineModules orders the fields: the
+// unresolved imports of every module, then the definitions of every module.
+// Resolved imports take the index of their target.
+void LayoutIndexSpace(const std::vector<Module*>& modules,
+                      const std::vector<ModuleImportMap>& import_map,
+                      ExternalKind kind,
+                      std::vector<ModuleIndexMap>* maps) {
+  Index next = 0;
+  for (size_t m = 0; m < modules.size(); ++m) {
+    std::vector<Index>& map = GetMap(&(*maps)[m], kind);
+    const std::vector<ImportTarget>& targets = import_map[m].Get(kind);
+    map.assign(NumEntities(modules[m], kind), kInvalidIndex);
+    for (Index i = 0; i < NumImports(modules[m], kind); ++i) {
+      if (!targets[i].is_resolved()) {
+        map[i] = next++;
+      }
+    }
+  }
+
+  for (size_t m = 0; m < modules.size(); ++m) {
+    std::vector<Index>& map = GetMap(&(*maps)[m], kind);
+    for (Index i = NumImports(modules[m], kind); i < map.size(); ++i) {
+      map[i] = next++;
+    }
+  }
+
+  for (size_t m = 0; m < modules.size(); ++m) {
+    std::vector<Index>& map = GetMap(&(*maps)[m], kind);
+    const std::vector<ImportTarget>& targets = import_map[m].Get(kind);
+    for (Index i = 0; i < NumImports(modules[m], kind); ++i) {
+      if (targets[i].is_resolved()) {
+        map[i] = GetMap(&(*maps)[targets[i].module], kind)[targets[i].index];
       }
-    } else {
-      temp_module.push_back(std::move(module->fields.extract_front()));
     }
   }
+}
+
+// Index spaces without imports are simply concatenated.
+void LayoutConcatenated(const std::vector<Module*>& modules,
+                        size_t (*count)(const Module*),
+                        std::vector<Index> ModuleIndexMap::*member,
+                        std::vector<ModuleIndexMap>* maps) {
+  Index next = 0;
+  for (size_t m = 0; m < modules.size(); ++m) {
+    std::vector<Index>& map = (*maps)[m].*member;
+    map.resize(count(modules[m]));
+    for (Index& index : map) {
+      index = next++;
+    }
+  }
+}
+
+}  // end anonymous namespace
+
+Result CombineModules(const std::vector<Module*>& modules, Module* result) {
+  std::map<std::string, size_t> module_indices;
+  for (size_t i = 0; i < modules.size(); ++i) {
+    module_indices.insert({modules[i]->name, i});
+  }
 
-  // Append imports of libmodule excluding imports from module 
-  while (!libmodule->fields.empty()) {
-    const ModuleField* field = &libmodule->fields.front();
-    if (field->type() == ModuleFieldType::Import) {
-      auto field_uniq_ptr = cast<ImportModuleField>(std::move(libmodule->fields.extract_front()));
-      if (field_uniq_ptr->import->module_name != module->name) {
-        result->AppendField(std::move(field_uniq_ptr));
+  std::vector<ModuleFieldList> temp_modules(modules.size());
+
+  // Append imports of every module excluding imports from the other modules
+  for (size_t i = 0; i < modules.size(); ++i) {
+    Module* module = modules[i];
+    while (!module->fields.empty()) {
+      const ModuleField* field = &module->fields.front();
+      if (field->type() == ModuleFieldType::Import) {
+        auto field_uniq_ptr = cast<ImportModuleField>(std::move(module->fields.extract_front()));
+        auto it = module_indices.find(field_uniq_ptr->import->module_name);
+        if (it == module_indices.end() || it->second == i) {
+          result->AppendField(std::move(field_uniq_ptr));
+        }
+      } else {
+        temp_modules[i].push_back(std::move(module->fields.extract_front()));
       }
-    } else {
-      temp_libmodule.push_back(std::move(libmodule->fields.extract_front()));
     }
   }
 
-  // Append the rest of module fields
-  result->AppendFields(&temp_module);
+  // Append the rest of the fields, module by module
+  for (ModuleFieldList& temp_module : temp_modules) {
+    result->AppendFields(&temp_module);
+  }
 
-  // Append the rest of libmodule fields
-  result->AppendFields(&temp_libmodule);
-  
   return Result::Ok;
 }
+
+Result CombineModulesByIndex(const std::vector<Module*>& modules,
+                             const std::vector<ModuleImportMap>& import_map,
+                             Module* result) {
+  std::vector<ModuleIndexMap> maps(modules.size());
+  const ExternalKind kinds[] = {ExternalKind::Func, ExternalKind::Table, ExternalKind::Memory,
+                                ExternalKind::Global, ExternalKind::Tag};
+  for (ExternalKind kind : kinds) {
+    LayoutIndexSpace(modules, import_map, kind, &maps);
+  }
+  LayoutConcatenated(modules, [](const Module* module) { return module->types.size(); },
+                     &ModuleIndexMap::types, &maps);
+  LayoutConcatenated(modules, [](const Module* module) { return module->data_segments.size(); },
+                     &ModuleIndexMap::data_segments, &maps);
+  LayoutConcatenated(modules, [](const Module* module) { return module->elem_segments.size(); },
+                     &ModuleIndexMap::elem_segments, &maps);
+
+  for (size_t m = 0; m < modules.size(); ++m) {
+    CHECK_RESULT(RemapIndices(modules[m], maps[m]));
+  }
+  return CombineModules(modules, result);
+}
+
 }
@@ -1,13 +1,25 @@
 #ifndef WABT_COMBINE_MODULES_H_
 #define WABT_COMBINE_MODULES_H_
 
+#include <vector>
+
 #include "wabt/common.h"
 
 namespace wabt {
 
 struct Module;
+struct ModuleImportMap;
+
+// Moves every field of |modules| into |result|. Imports from one of the other
+// input modules are dropped; all remaining imports come first, in input order.
+Result CombineModules( const std::vector<struct Module*>&, struct Module* );
 
-Result CombineModules( struct Module*, struct Module*, struct Module* );
+// Like CombineModules, but merges in index space: every Var of every input is
+// first rewritten to its index in |result|, with resolved imports replaced by
+// the index of their target, so no names are generated or needed.
+Result CombineModulesByIndex( const std::vector<struct Module*>&,
+                              const std::vector<ModuleImportMap>&,
+                              struct Module* );
 
 }
 
@@ -0,0 +1,155 @@
+#include "deduplicate-types.h"
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "wabt/cast.h"
+#include "wabt/expr-visitor.h"
+#include "wabt/ir.h"
+
+#include "remap-indices.h"
+
+namespace wabt {
+
+namespace {
+
+size_t HashTypes(size_t hash, const TypeVector& types) {
+  hash = hash * 31 + types.size();
+  for (Type type : types) {
+    hash = hash * 31 + std::hash<int32_t>()(static_cast<int32_t>(static_cast<Type::Enum>(type)));
+  }
+  return hash;
+}
+
+size_t HashSignature(const FuncSignature& sig) {
+  return HashTypes(HashTypes(0, sig.param_types), sig.result_types);
+}
+
+bool HasIndexedType(const TypeVector& types) {
+  for (Type type : types) {
+    if (type.IsReferenceWithIndex()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HasIndexedType(const FuncSignature& sig) {
+  return HasIndexedType(sig.param_types) || HasIndexedType(sig.result_types);
+}
+
+// Finds reference types carrying a type index in function bodies, which
+// ApplyIndexMap leaves as they are.
+class IndexedTypeFinder : public ExprVisitor::DelegateNop {
+ public:
+  bool found() const { return found_; }
+
+  // Implementation of ExprVisitor::DelegateNop.
+  Result BeginBlockExpr(BlockExpr* expr) override { return OnBlock(expr->block); }
+  Result BeginLoopExpr(LoopExpr* expr) override { return OnBlock(expr->block); }
+  Result BeginIfExpr(IfExpr* expr) override { return OnBlock(expr->true_); }
+  Result BeginTryExpr(TryExpr* expr) override { return OnBlock(expr->block); }
+  Result OnSelectExpr(SelectExpr* expr) override {
+    found_ = found_ || HasIndexedType(expr->result_type);
+    return Result::Ok;
+  }
+  Result OnRefNullExpr(RefNullExpr* expr) override {
+    found_ = found_ || expr->type.IsReferenceWithIndex();
+    return Result::Ok;
+  }
+
+ private:
+  Result OnBlock(const Block& block) {
+    found_ = found_ || HasIndexedType(block.decl.sig);
+    return Result::Ok;
+  }
+
+  bool found_ = false;
+};
+
+// Type indices inside non-function types and indexed reference types aren't
+// remapped, so renumbering types would leave them pointing at other entries.
+bool HasUnmappedTypeIndices(Module* module) {
+  for (const TypeEntry* type : module->types) {
+    const FuncType* func_type = dyn_cast<FuncType>(type);
+    if (!func_type || HasIndexedType(func_type->sig)) {
+      return true;
+    }
+  }
+  for (const Global* global : module->globals) {
+    if (global->type.IsReferenceWithIndex()) {
+      return true;
+    }
+  }
+  for (const Table* table : module->tables) {
+    if (table->elem_type.IsReferenceWithIndex()) {
+      return true;
+    }
+  }
+  for (const ElemSegment* segment : module->elem_segments) {
+    if (segment->elem_type.IsReferenceWithIndex()) {
+      return true;
+    }
+  }
+
+  IndexedTypeFinder finder;
+  ExprVisitor visitor(&finder);
+  for (Func* func : module->funcs) {
+    if (HasIndexedType(func->decl.sig)) {
+      return true;
+    }
+    for (Type type : func->local_types) {
+      if (type.IsReferenceWithIndex()) {
+        return true;
+      }
+    }
+    if (Failed(visitor.VisitFunc(func)) || finder.found()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // end anonymous namespace
+
+Result DeduplicateTypes(Module* module) {
+  if (HasUnmappedTypeIndices(module)) {
+    return Result::Ok;
+  }
+
+  ModuleIndexMap map;
+  map.types.resize(module->types.size());
+
+  // Signature hash to the old index of the first type with that hash.
+  std::unordered_multimap<size_t, Index> canonical;
+  Index next = 0;
+  bool merged = false;
+  for (Index i = 0; i < module->types.size(); ++i) {
+    const FuncType* type = cast<FuncType>(module->types[i]);
+    size_t hash = HashSignature(type->sig);
+    Index match = kInvalidIndex;
+    auto range = canonical.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (cast<FuncType>(module->types[it->second])->sig == type->sig) {
+        match = it->second;
+        break;
+      }
+    }
+
+    if (match == kInvalidIndex) {
+      canonical.emplace(hash, i);
+      map.types[i] = next++;
+    } else {
+      map.types[i] = map.types[match];
+      merged = true;
+    }
+  }
+
+  if (!merged) {
+    return Result::Ok;
+  }
+  return ApplyIndexMap(module, map);
+}
+
+}  // namespace wabt
@@ -0,0 +1,18 @@
+#ifndef WABT_DEDUPLICATE_TYPES_H_
+#define WABT_DEDUPLICATE_TYPES_H_
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+struct Module;
+
+// Merges structurally equal function types of |module| into the first of
+// them and remaps every type Var to the merged index. Modules with
+// non-function types or reference types carrying a type index are left as
+// they are, since those indices aren't remapped.
+Result DeduplicateTypes(struct Module*);
+
+}  // namespace wabt
+
+#endif /* WABT_DEDUPLICATE_TYPES_H_ */
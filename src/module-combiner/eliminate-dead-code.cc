@@ -0,0 +1,396 @@
+#include "eliminate-dead-code.h"
+
+#include <memory>
+#include <vector>
+
+#include "wabt/cast.h"
+#include "wabt/expr-visitor.h"
+#include "wabt/ir.h"
+
+#include "remap-indices.h"
+
+namespace wabt {
+
+namespace {
+
+class LivenessMarker : public ExprVisitor::DelegateNop {
+ public:
+  explicit LivenessMarker(Module* module);
+
+  Result MarkModule();
+
+  // Old index to new index of every live entity, kInvalidIndex if dead.
+  ModuleIndexMap BuildIndexMap() const;
+
+  // Implementation of ExprVisitor::DelegateNop.
+  Result BeginBlockExpr(BlockExpr*) override;
+  Result BeginLoopExpr(LoopExpr*) override;
+  Result BeginIfExpr(IfExpr*) override;
+  Result BeginTryExpr(TryExpr*) override;
+  Result OnCallExpr(CallExpr*) override;
+  Result OnCallIndirectExpr(CallIndirectExpr*) override;
+  Result OnReturnCallExpr(ReturnCallExpr*) override;
+  Result OnReturnCallIndirectExpr(ReturnCallIndirectExpr*) override;
+  Result OnRefFuncExpr(RefFuncExpr*) override;
+  Result OnGlobalGetExpr(GlobalGetExpr*) override;
+  Result OnGlobalSetExpr(GlobalSetExpr*) override;
+  Result OnMemoryInitExpr(MemoryInitExpr*) override;
+  Result OnDataDropExpr(DataDropExpr*) override;
+  Result OnTableInitExpr(TableInitExpr*) override;
+  Result OnElemDropExpr(ElemDropExpr*) override;
+
+ private:
+  void MarkFunc(const Var& var);
+  void MarkFuncIndex(Index index);
+  void MarkGlobal(const Var& var);
+  void MarkGlobalIndex(Index index);
+  void MarkDecl(const FuncDeclaration& decl);
+  void MarkTypeIndex(Index index);
+  void MarkDataSegment(const Var& var);
+  void MarkElemSegmentIndex(Index index);
+  Result Drain();
+  void DeclareRefFuncs();
+
+  Module* module_;
+  ExprVisitor visitor_;
+  std::vector<bool> funcs_;
+  std::vector<bool> globals_;
+  std::vector<bool> types_;
+  std::vector<bool> data_segments_;
+  std::vector<bool> elem_segments_;
+  // Functions that a live function body takes a ref.func of.
+  std::vector<bool> ref_funcs_;
+  bool in_func_body_ = false;
+  // Entities that are marked but whose references are not marked yet.
+  std::vector<Index> func_worklist_;
+  std::vector<Index> global_worklist_;
+  std::vector<Index> elem_segment_worklist_;
+};
+
+LivenessMarker::LivenessMarker(Module* module)
+    : module_(module),
+      visitor_(this),
+      funcs_(module->funcs.size()),
+      globals_(module->globals.size()),
+      types_(module->types.size()),
+      data_segments_(module->data_segments.size()),
+      elem_segments_(module->elem_segments.size()),
+      ref_funcs_(module->funcs.size()) {}
+
+void LivenessMarker::MarkFunc(const Var& var) {
+  MarkFuncIndex(module_->GetFuncIndex(var));
+}
+
+void LivenessMarker::MarkFuncIndex(Index index) {
+  if (index < funcs_.size() && !funcs_[index]) {
+    funcs_[index] = true;
+    func_worklist_.push_back(index);
+  }
+}
+
+void LivenessMarker::MarkGlobal(const Var& var) {
+  MarkGlobalIndex(module_->GetGlobalIndex(var));
+}
+
+void LivenessMarker::MarkGlobalIndex(Index index) {
+  if (index < globals_.size() && !globals_[index]) {
+    globals_[index] = true;
+    global_worklist_.push_back(index);
+  }
+}
+
+// Declarations without an explicit type may still be written with the index
+// of a matching type.
+void LivenessMarker::MarkDecl(const FuncDeclaration& decl) {
+  MarkTypeIndex(module_->GetFuncTypeIndex(decl));
+}
+
+void LivenessMarker::MarkTypeIndex(Index index) {
+  if (index < types_.size()) {
+    types_[index] = true;
+  }
+}
+
+void LivenessMarker::MarkDataSegment(const Var& var) {
+  Index index = module_->GetDataSegmentIndex(var);
+  if (index < data_segments_.size()) {
+    data_segments_[index] = true;
+  }
+}
+
+void LivenessMarker::MarkElemSegmentIndex(Index index) {
+  if (index < elem_segments_.size() && !elem_segments_[index]) {
+    elem_segments_[index] = true;
+    elem_segment_worklist_.push_back(index);
+  }
+}
+
+Result LivenessMarker::BeginBlockExpr(BlockExpr* expr) {
+  MarkDecl(expr->block.decl);
+  return Result::Ok;
+}
+
+Result LivenessMarker::BeginLoopExpr(LoopExpr* expr) {
+  MarkDecl(expr->block.decl);
+  return Result::Ok;
+}
+
+Result LivenessMarker::BeginIfExpr(IfExpr* expr) {
+  MarkDecl(expr->true_.decl);
+  return Result::Ok;
+}
+
+Result LivenessMarker::BeginTryExpr(TryExpr* expr) {
+  MarkDecl(expr->block.decl);
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnCallExpr(CallExpr* expr) {
+  MarkFunc(expr->var);
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnCallIndirectExpr(CallIndirectExpr* expr) {
+  MarkDecl(expr->decl);
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnReturnCallExpr(ReturnCallExpr* expr) {
+  MarkFunc(expr->var);
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnReturnCallIndirectExpr(ReturnCallIndirectExpr* expr) {
+  MarkDecl(expr->decl);
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnRefFuncExpr(RefFuncExpr* expr) {
+  Index index = module_->GetFuncIndex(expr->var);
+  MarkFuncIndex(index);
+  if (in_func_body_ && index < ref_funcs_.size()) {
+    ref_funcs_[index] = true;
+  }
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnGlobalGetExpr(GlobalGetExpr* expr) {
+  MarkGlobal(expr->var);
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnGlobalSetExpr(GlobalSetExpr* expr) {
+  MarkGlobal(expr->var);
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnMemoryInitExpr(MemoryInitExpr* expr) {
+  MarkDataSegment(expr->var);
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnDataDropExpr(DataDropExpr* expr) {
+  MarkDataSegment(expr->var);
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnTableInitExpr(TableInitExpr* expr) {
+  MarkElemSegmentIndex(module_->GetElemSegmentIndex(expr->segment_index));
+  return Result::Ok;
+}
+
+Result LivenessMarker::OnElemDropExpr(ElemDropExpr* expr) {
+  MarkElemSegmentIndex(module_->GetElemSegmentIndex(expr->var));
+  return Result::Ok;
+}
+
+// Marks everything referenced by the entities on the worklists until they
+// are empty.
+Result LivenessMarker::Drain() {
+  while (!func_worklist_.empty() || !global_worklist_.empty()
+         || !elem_segment_worklist_.empty()) {
+    if (!func_worklist_.empty()) {
+      Func* func = module_->funcs[func_worklist_.back()];
+      func_worklist_.pop_back();
+      MarkDecl(func->decl);
+      in_func_body_ = true;
+      Result result = visitor_.VisitFunc(func);
+      in_func_body_ = false;
+      CHECK_RESULT(result);
+    } else if (!global_worklist_.empty()) {
+      Global* global = module_->globals[global_worklist_.back()];
+      global_worklist_.pop_back();
+      CHECK_RESULT(visitor_.VisitExprList(global->init_expr));
+    } else {
+      ElemSegment* segment = module_->elem_segments[elem_segment_worklist_.back()];
+      elem_segment_worklist_.pop_back();
+      CHECK_RESULT(visitor_.VisitExprList(segment->offset));
+      for (ExprList& elem_expr : segment->elem_exprs) {
+        CHECK_RESULT(visitor_.VisitExprList(elem_expr));
+      }
+    }
+  }
+  return Result::Ok;
+}
+
+Result LivenessMarker::MarkModule() {
+  // Non-function types can refer to each other in ways that aren't tracked
+  // here, so they keep every type alive.
+  for (const TypeEntry* type : module_->types) {
+    if (!isa<FuncType>(type)) {
+      types_.assign(types_.size(), true);
+      break;
+    }
+  }
+
+  for (Index i = 0; i < module_->num_func_imports; ++i) {
+    MarkFuncIndex(i);
+  }
+  for (Index i = 0; i < module_->num_global_imports; ++i) {
+    MarkGlobalIndex(i);
+  }
+  for (const Tag* tag : module_->tags) {
+    MarkDecl(tag->decl);
+  }
+
+  for (const Export* export_ : module_->exports) {
+    switch (export_->kind) {
+      case ExternalKind::Func:
+        MarkFunc(export_->var);
+        break;
+      case ExternalKind::Global:
+        MarkGlobal(export_->var);
+        break;
+      default:
+        break;
+    }
+  }
+  for (const Var* start : module_->starts) {
+    MarkFunc(*start);
+  }
+
+  // Active segments are applied at instantiation and may trap, so they stay
+  // even if nothing reads what they write.
+  for (Index i = 0; i < module_->elem_segments.size(); ++i) {
+    if (module_->elem_segments[i]->kind == SegmentKind::Active) {
+      MarkElemSegmentIndex(i);
+    }
+  }
+  for (Index i = 0; i < module_->data_segments.size(); ++i) {
+    DataSegment* segment = module_->data_segments[i];
+    if (segment->kind == SegmentKind::Active) {
+      data_segments_[i] = true;
+      CHECK_RESULT(visitor_.VisitExprList(segment->offset));
+    }
+  }
+  CHECK_RESULT(Drain());
+
+  // A declarative segment only declares the functions it lists for ref.func,
+  // so it keeps nothing alive. Keep it, with only its live functions, while
+  // one of them is still live.
+  for (Index i = 0; i < module_->elem_segments.size(); ++i) {
+    ElemSegment* segment = module_->elem_segments[i];
+    if (segment->kind != SegmentKind::Declared) {
+      continue;
+    }
+    ExprListVector live_exprs;
+    for (ExprList& elem_expr : segment->elem_exprs) {
+      const Expr& expr = elem_expr.front();
+      if (expr.type() != ExprType::RefFunc) {
+        continue;
+      }
+      Index func_index = module_->GetFuncIndex(cast<RefFuncExpr>(&expr)->var);
+      if (func_index < funcs_.size() && funcs_[func_index]) {
+        live_exprs.push_back(std::move(elem_expr));
+      }
+    }
+    segment->elem_exprs = std::move(live_exprs);
+    elem_segments_[i] = !segment->elem_exprs.empty();
+  }
+  DeclareRefFuncs();
+  return Result::Ok;
+}
+
+// A ref.func in a function body needs its function declared by an export, a
+// global or an elem segment. The one declaring it may have been dead, so the
+// functions no longer declared get a declarative segment of their own.
+void LivenessMarker::DeclareRefFuncs() {
+  std::vector<bool> declared(funcs_.size());
+  auto declare = [&](const ExprList& exprs) {
+    for (const Expr& expr : exprs) {
+      if (expr.type() == ExprType::RefFunc) {
+        Index index = module_->GetFuncIndex(cast<RefFuncExpr>(&expr)->var);
+        if (index < declared.size()) {
+          declared[index] = true;
+        }
+      }
+    }
+  };
+  for (const Export* export_ : module_->exports) {
+    if (export_->kind == ExternalKind::Func) {
+      Index index = module_->GetFuncIndex(export_->var);
+      if (index < declared.size()) {
+        declared[index] = true;
+      }
+    }
+  }
+  for (Index i = 0; i < module_->globals.size(); ++i) {
+    if (globals_[i]) {
+      declare(module_->globals[i]->init_expr);
+    }
+  }
+  for (Index i = 0; i < module_->elem_segments.size(); ++i) {
+    if (elem_segments_[i]) {
+      for (const ExprList& elem_expr : module_->elem_segments[i]->elem_exprs) {
+        declare(elem_expr);
+      }
+    }
+  }
+
+  auto field = std::make_unique<ElemSegmentModuleField>();
+  ElemSegment& segment = field->elem_segment;
+  segment.kind = SegmentKind::Declared;
+  segment.elem_type = Type::FuncRef;
+  for (Index i = 0; i < ref_funcs_.size(); ++i) {
+    if (ref_funcs_[i] && !declared[i]) {
+      ExprList elem_expr;
+      elem_expr.push_back(std::make_unique<RefFuncExpr>(Var(i, Location())));
+      segment.elem_exprs.push_back(std::move(elem_expr));
+    }
+  }
+  if (!segment.elem_exprs.empty()) {
+    module_->AppendField(std::move(field));
+    elem_segments_.push_back(true);
+  }
+}
+
+ModuleIndexMap LivenessMarker::BuildIndexMap() const {
+  auto build = [](const std::vector<bool>& live) {
+    std::vector<Index> map(live.size(), kInvalidIndex);
+    Index next = 0;
+    for (Index i = 0; i < live.size(); ++i) {
+      if (live[i]) {
+        map[i] = next++;
+      }
+    }
+    return map;
+  };
+
+  ModuleIndexMap map;
+  map.funcs = build(funcs_);
+  map.globals = build(globals_);
+  map.types = build(types_);
+  map.data_segments = build(data_segments_);
+  map.elem_segments = build(elem_segments_);
+  return map;
+}
+
+}  // end anonymous namespace
+
+Result EliminateDeadCode(Module* module) {
+  LivenessMarker marker(module);
+  CHECK_RESULT(marker.MarkModule());
+  return ApplyIndexMap(module, marker.BuildIndexMap());
+}
+
+}  // namespace wabt
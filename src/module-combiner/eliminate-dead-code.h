@@ -0,0 +1,19 @@
+#ifndef WABT_ELIMINATE_DEAD_CODE_H_
+#define WABT_ELIMINATE_DEAD_CODE_H_
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+struct Module;
+
+// Drops the functions, globals, types and data and elem segments of |module|
+// that can't be reached from its exports, start function, imports or active
+// segments. Tables, memories, tags and imports are always kept. Functions a
+// live body takes a ref.func of stay declared: if every export, global and
+// segment declaring one is gone, a declarative segment listing it is added.
+Result EliminateDeadCode(struct Module*);
+
+}  // namespace wabt
+
+#endif /* WABT_ELIMINATE_DEAD_CODE_H_ */
@@ -18,33 +18,55 @@
 
 #include <cassert>
 #include <cstdio>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "wabt/cast.h"
 #include "wabt/expr-visitor.h"
 #include "wabt/ir.h"
 
+#include "parallel.h"
+
 namespace wabt {
 
-inline std::string IndexToAlphaName(Index index) {
-  std::string s;
+inline void AppendAlphaName(Index index, std::string* s) {
   do {
     // For multiple chars, put most frequently changing char first.
-    s += 'a' + (index % 26);
+    *s += 'a' + (index % 26);
     index /= 26;
     // Continue remaining sequence with 'a' rather than 'b'.
   } while (index--);
-  return s;
+}
+
+inline void AppendDecimal(Index value, std::string* s) {
+  char digits[10];
+  char* end = digits + sizeof(digits);
+  char* p = end;
+  do {
+    *--p = '0' + (value % 10);
+    value /= 10;
+  } while (value != 0);
+  s->append(p, end - p);
 }
 
 namespace {
 
+// Bodies are handed to the workers in runs, so each walks neighbouring
+// bodies, which the reader allocated next to each other.
+constexpr size_t kFuncsPerTask = 32;
+
 class NameGenerator : public ExprVisitor::DelegateNop {
  public:
   NameGenerator(PrefixNameOpts opts);
 
-  Result VisitModule(Module* module);
+  Result VisitModule(Module* module, unsigned num_threads);
+
+  // Names the labels in the body of |func_index|. This only touches the
+  // function itself, so one NameGenerator per thread can visit the bodies of
+  // a module concurrently.
+  Result VisitFuncBody(Module* module, Index func_index);
 
   // Implementation of ExprVisitor::DelegateNop.
   Result BeginBlockExpr(BlockExpr* expr) override;
@@ -57,7 +79,7 @@ class NameGenerator : public ExprVisitor::DelegateNop {
   // Generate a name with the given prefix, followed by the index and
   // optionally a disambiguating number. If index == kInvalidIndex, the index
   // is not appended.
-  void GenerateName(const char* prefix,
+  void GenerateName(std::string_view prefix,
                     Index index,
                     unsigned disambiguator,
                     std::string* out_str);
@@ -85,7 +107,7 @@ class NameGenerator : public ExprVisitor::DelegateNop {
   // appending the index. If the name already exists, a disambiguating suffix
   // is added.
   void MaybeUseAndBindName(BindingHash* bindings,
-                           const char* name,
+                           std::string_view name,
                            Index index,
                            std::string* out_str);
 
@@ -111,7 +133,15 @@ class NameGenerator : public ExprVisitor::DelegateNop {
   Result VisitImport(Import* import);
   Result VisitExport(Export* export_);
 
+  void SetModule(Module* module);
+
   Module* module_ = nullptr;
+  // "$" + module_->name + "_", the start of every generated name.
+  std::string module_prefix_;
+  // Scratch space names are built in, so that building a name costs no
+  // allocations beyond the final copy.
+  std::string buffer_;
+  std::string import_name_;
   ExprVisitor visitor_;
   Index label_count_ = 0;
 
@@ -125,37 +155,46 @@ class NameGenerator : public ExprVisitor::DelegateNop {
 };
 
 NameGenerator::NameGenerator(PrefixNameOpts opts)
-  : visitor_(this), opts_(opts) {}
+  : visitor_(this), opts_(opts) {
+  buffer_.reserve(64);
+}
+
+void NameGenerator::SetModule(Module* module) {
+  module_ = module;
+  module_prefix_.assign("$");
+  module_prefix_ += module->name;
+  module_prefix_ += '_';
+}
 
 // static
 bool NameGenerator::HasName(const std::string& str) {
   return !str.empty();
 }
 
-void NameGenerator::GenerateName(const char* prefix,
+void NameGenerator::GenerateName(std::string_view prefix,
                                  Index index,
                                  unsigned disambiguator,
                                  std::string* str) {
-  *str = "$";
-  *str += module_->name;
-  *str += "_";
-  *str += prefix;
+  buffer_.assign(module_prefix_);
+  buffer_.append(prefix);
   if (index != kInvalidIndex) {
     if (opts_ & PrefixNameOpts::PrefixAlphaNames) {
       // For params and locals, do not use a prefix char.
-      if (!strcmp(prefix, "p") || !strcmp(prefix, "l")) {
-        str->pop_back();
+      if (prefix == "p" || prefix == "l") {
+        buffer_.pop_back();
       } else {
-        *str += '_';
+        buffer_ += '_';
       }
-      *str += IndexToAlphaName(index);
+      AppendAlphaName(index, &buffer_);
     } else {
-      *str += std::to_string(index);
+      AppendDecimal(index, &buffer_);
     }
   }
   if (disambiguator != 0) {
-    *str += '_' + std::to_string(disambiguator);
+    buffer_ += '_';
+    AppendDecimal(disambiguator, &buffer_);
   }
+  str->assign(buffer_);
 }
 
 void NameGenerator::MaybeGenerateName(const char* prefix,
@@ -188,16 +227,14 @@ void NameGenerator::GenerateAndBindName(BindingHash* bindings,
 
 void NameGenerator::AddPrefixToName(Index index,
                                     std::string* str) {
-  std::string prefix_name = "$";
-  prefix_name += module_->name;
-  prefix_name += "_";
-  if (str->compare(0, prefix_name.length(), prefix_name) != 0) {
-    if (str->at(0) == '$') {
-      prefix_name += str->substr(1);
-    } else {
-      prefix_name += *str;
+  if (str->compare(0, module_prefix_.length(), module_prefix_) != 0) {
+    std::string_view name = *str;
+    if (name[0] == '$') {
+      name.remove_prefix(1);
     }
-    *str = prefix_name;
+    buffer_.assign(module_prefix_);
+    buffer_.append(name);
+    str->assign(buffer_);
   }
   return;
 }
@@ -225,7 +262,7 @@ void NameGenerator::MaybeGenerateAndBindName(BindingHash* bindings,
 }
 
 void NameGenerator::MaybeUseAndBindName(BindingHash* bindings,
-                                        const char* name,
+                                        std::string_view name,
                                         Index index,
                                         std::string* str) {
   if (!HasName(*str)) {
@@ -262,11 +299,17 @@ Result NameGenerator::BeginIfExpr(IfExpr* expr) {
 Result NameGenerator::VisitFunc(Index func_index, Func* func) {
   MaybeGenerateAndBindName(&module_->func_bindings, "f", func_index,
                            &func->name);
-  label_count_ = 0;
-  CHECK_RESULT(visitor_.VisitFunc(func));
   return Result::Ok;
 }
 
+Result NameGenerator::VisitFuncBody(Module* module, Index func_index) {
+  if (module_ != module) {
+    SetModule(module);
+  }
+  label_count_ = 0;
+  return visitor_.VisitFunc(module->funcs[func_index]);
+}
+
 Result NameGenerator::VisitGlobal(Index global_index, Global* global) {
   MaybeGenerateAndBindName(&module_->global_bindings, "g", global_index,
                            &global->name);
@@ -359,8 +402,10 @@ Result NameGenerator::VisitImport(Import* import) {
 
   if (bindings && name) {
     assert(index != kInvalidIndex);
-    std::string new_name = import->module_name + '.' + import->field_name;
-    MaybeUseAndBindName(bindings, new_name.c_str(), index, name);
+    import_name_.assign(import->module_name);
+    import_name_ += '.';
+    import_name_ += import->field_name;
+    MaybeUseAndBindName(bindings, import_name_, index, name);
   }
 
   return Result::Ok;
@@ -414,7 +459,7 @@ Result NameGenerator::VisitExport(Export* export_) {
   }
 
   if (bindings && name) {
-    MaybeUseAndBindName(bindings, export_->name.c_str(), index, name);
+    MaybeUseAndBindName(bindings, export_->name, index, name);
   }
 
   return Result::Ok;
@@ -429,8 +474,8 @@ Result NameGenerator::VisitAll(const std::vector<T*>& items,
   return Result::Ok;
 }
 
-Result NameGenerator::VisitModule(Module* module) {
-  module_ = module;
+Result NameGenerator::VisitModule(Module* module, unsigned num_threads) {
+  SetModule(module);
   // Visit imports and exports first to give better names, derived from the
   // import/export name.
   for (auto* import : module->imports) {
@@ -448,15 +493,43 @@ Result NameGenerator::VisitModule(Module* module) {
   VisitAll(module->tags, &NameGenerator::VisitTag);
   VisitAll(module->data_segments, &NameGenerator::VisitDataSegment);
   VisitAll(module->elem_segments, &NameGenerator::VisitElemSegment);
-  module_ = nullptr;
-  return Result::Ok;
+
+  // Everything above shares the module's binding hashes and runs serially.
+  // Labels are local to their function, so the bodies are sharded, with a
+  // generator per worker.
+  unsigned num_workers = NumWorkers(num_threads, module->funcs.size());
+  if (num_workers <= 1) {
+    Result result = Result::Ok;
+    for (Index i = 0; i < module->funcs.size(); ++i) {
+      result |= VisitFuncBody(module, i);
+    }
+    return result;
+  }
+
+  std::vector<std::unique_ptr<NameGenerator>> generators;
+  std::vector<Result> results(num_workers, Result::Ok);
+  for (unsigned i = 0; i < num_workers; ++i) {
+    generators.push_back(std::make_unique<NameGenerator>(opts_));
+  }
+  ParallelFor(
+      module->funcs.size(), num_workers,
+      [&](unsigned worker, size_t i) {
+        results[worker] |= generators[worker]->VisitFuncBody(module, i);
+      },
+      kFuncsPerTask);
+
+  Result result = Result::Ok;
+  for (Result worker_result : results) {
+    result |= worker_result;
+  }
+  return result;
 }
 
 }  // end anonymous namespace
 
-Result GeneratePrefixNames(Module* module, PrefixNameOpts opts) {
+Result GeneratePrefixNames(Module* module, PrefixNameOpts opts, unsigned num_threads) {
   NameGenerator generator(opts);
-  return generator.VisitModule(module);
+  return generator.VisitModule(module, num_threads);
 }
 
 }  // namespace wabt
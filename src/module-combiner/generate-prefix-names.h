@@ -28,7 +28,11 @@ enum PrefixNameOpts {
   PrefixAlphaNames = 1 << 0,
 };
 
-Result GeneratePrefixNames(struct Module*, PrefixNameOpts opts = PrefixNameOpts::PrefixNone);
+// Function bodies are named on up to |num_threads| threads; 0 means one per
+// hardware thread.
+Result GeneratePrefixNames(struct Module*,
+                           PrefixNameOpts opts = PrefixNameOpts::PrefixNone,
+                           unsigned num_threads = 1);
 
 }  // namespace wabt
 
@@ -0,0 +1,191 @@
+#include "inline-forwarding-stubs.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "wabt/cast.h"
+#include "wabt/expr-visitor.h"
+#include "wabt/ir.h"
+
+#include "remap-indices.h"
+
+namespace wabt {
+
+namespace {
+
+// Returns the callee if |func| is a forwarding stub, else kInvalidIndex.
+Index GetStubTarget(const Module* module, const Func* func) {
+  Index num_params = func->GetNumParams();
+  if (func->exprs.size() != num_params + 1) {
+    return kInvalidIndex;
+  }
+
+  Index param = 0;
+  for (const Expr& expr : func->exprs) {
+    if (param < num_params) {
+      if (expr.type() != ExprType::LocalGet
+          || func->GetLocalIndex(cast<LocalGetExpr>(&expr)->var) != param) {
+        return kInvalidIndex;
+      }
+      param++;
+      continue;
+    }
+
+    const Var* callee;
+    if (expr.type() == ExprType::Call) {
+      callee = &cast<CallExpr>(&expr)->var;
+    } else if (expr.type() == ExprType::ReturnCall) {
+      callee = &cast<ReturnCallExpr>(&expr)->var;
+    } else {
+      return kInvalidIndex;
+    }
+    Index target = module->GetFuncIndex(*callee);
+    if (target >= module->funcs.size() || module->funcs[target] == func
+        || !(module->funcs[target]->decl.sig == func->decl.sig)) {
+      return kInvalidIndex;
+    }
+    return target;
+  }
+  return kInvalidIndex;
+}
+
+class StubInliner : public ExprVisitor::DelegateNop {
+ public:
+  StubInliner(Module* module, const std::vector<Index>& targets)
+      : module_(module), targets_(targets), visitor_(this) {}
+
+  Result VisitFunc(Func* func) { return visitor_.VisitFunc(func); }
+
+  Result OnCallExpr(CallExpr* expr) override {
+    Redirect(&expr->var);
+    return Result::Ok;
+  }
+
+  Result OnReturnCallExpr(ReturnCallExpr* expr) override {
+    Redirect(&expr->var);
+    return Result::Ok;
+  }
+
+ private:
+  void Redirect(Var* var) {
+    Index index = module_->GetFuncIndex(*var);
+    if (index < targets_.size() && targets_[index] != kInvalidIndex) {
+      var->set_index(targets_[index]);
+    }
+  }
+
+  Module* module_;
+  const std::vector<Index>& targets_;
+  ExprVisitor visitor_;
+};
+
+// Marks the functions referenced other than by a direct call.
+class AddressTakenMarker : public ExprVisitor::DelegateNop {
+ public:
+  AddressTakenMarker(Module* module, std::vector<bool>* taken)
+      : module_(module), taken_(taken), visitor_(this) {}
+
+  Result VisitExprList(ExprList& exprs) { return visitor_.VisitExprList(exprs); }
+  Result VisitFunc(Func* func) { return visitor_.VisitFunc(func); }
+
+  Result OnRefFuncExpr(RefFuncExpr* expr) override {
+    Mark(expr->var);
+    return Result::Ok;
+  }
+
+  void Mark(const Var& var) {
+    Index index = module_->GetFuncIndex(var);
+    if (index < taken_->size()) {
+      (*taken_)[index] = true;
+    }
+  }
+
+ private:
+  Module* module_;
+  std::vector<bool>* taken_;
+  ExprVisitor visitor_;
+};
+
+}  // end anonymous namespace
+
+Result InlineForwardingStubs(Module* module) {
+  Index num_funcs = module->funcs.size();
+  std::vector<Index> targets(num_funcs, kInvalidIndex);
+  bool found = false;
+  for (Index i = module->num_func_imports; i < num_funcs; ++i) {
+    targets[i] = GetStubTarget(module, module->funcs[i]);
+    found |= targets[i] != kInvalidIndex;
+  }
+  if (!found) {
+    return Result::Ok;
+  }
+
+  // Collapse chains of stubs onto their final target. Every stub on a cycle
+  // of stubs, or on a chain leading into one, has no final target and is
+  // left alone. Each stub is followed once: a chain stops at a stub whose
+  // end is already known.
+  enum : uint8_t { kUnvisited, kOnChain, kDone };
+  std::vector<uint8_t> state(num_funcs, kUnvisited);
+  std::vector<Index> ends(num_funcs, kInvalidIndex);
+  std::vector<Index> chain;
+  for (Index i = 0; i < num_funcs; ++i) {
+    if (targets[i] == kInvalidIndex || state[i] != kUnvisited) {
+      continue;
+    }
+    chain.clear();
+    Index func = i;
+    while (targets[func] != kInvalidIndex && state[func] == kUnvisited) {
+      state[func] = kOnChain;
+      chain.push_back(func);
+      func = targets[func];
+    }
+    Index end = func;
+    if (targets[func] != kInvalidIndex) {
+      end = state[func] == kOnChain ? kInvalidIndex : ends[func];
+    }
+    for (Index stub : chain) {
+      state[stub] = kDone;
+      ends[stub] = end;
+    }
+  }
+  targets = std::move(ends);
+
+  StubInliner inliner(module, targets);
+  for (Func* func : module->funcs) {
+    CHECK_RESULT(inliner.VisitFunc(func));
+  }
+
+  // Stubs whose address is taken or that are exported keep their identity.
+  std::vector<bool> taken(num_funcs);
+  AddressTakenMarker marker(module, &taken);
+  for (Func* func : module->funcs) {
+    CHECK_RESULT(marker.VisitFunc(func));
+  }
+  for (Global* global : module->globals) {
+    CHECK_RESULT(marker.VisitExprList(global->init_expr));
+  }
+  for (ElemSegment* segment : module->elem_segments) {
+    for (ExprList& elem_expr : segment->elem_exprs) {
+      CHECK_RESULT(marker.VisitExprList(elem_expr));
+    }
+  }
+  for (const Export* export_ : module->exports) {
+    if (export_->kind == ExternalKind::Func) {
+      marker.Mark(export_->var);
+    }
+  }
+  for (const Var* start : module->starts) {
+    marker.Mark(*start);
+  }
+
+  ModuleIndexMap map;
+  map.funcs.resize(num_funcs);
+  Index next = 0;
+  for (Index i = 0; i < num_funcs; ++i) {
+    map.funcs[i] = targets[i] != kInvalidIndex && !taken[i] ? kInvalidIndex : next++;
+  }
+  return ApplyIndexMap(module, map);
+}
+
+}  // namespace wabt
@@ -0,0 +1,18 @@
+#ifndef WABT_INLINE_FORWARDING_STUBS_H_
+#define WABT_INLINE_FORWARDING_STUBS_H_
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+struct Module;
+
+// A forwarding stub is a function whose body only passes its params, in
+// order, to a call of a function with the same signature. Every call of a
+// stub is redirected to the function at the end of the chain of stubs, and
+// stubs that are no longer referenced are removed.
+Result InlineForwardingStubs(struct Module*);
+
+}  // namespace wabt
+
+#endif /* WABT_INLINE_FORWARDING_STUBS_H_ */
@@ -0,0 +1,143 @@
+#include "instrument-profile.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "wabt/cast.h"
+#include "wabt/expr-visitor.h"
+#include "wabt/ir.h"
+
+namespace wabt {
+
+const char kProfileDumpExport[] = "__profile_dump";
+
+namespace {
+
+class ProfileInstrumenter : public ExprVisitor::DelegateNop {
+ public:
+  ProfileInstrumenter(Module* module, std::vector<ProfileCounter>* counters)
+      : module_(module), counters_(counters), visitor_(this) {}
+
+  Result InstrumentFunc(Index func_index, Func* func);
+  void AppendDumpFunc();
+
+  // Implementation of ExprVisitor::DelegateNop.
+  Result BeginLoopExpr(LoopExpr*) override;
+
+ private:
+  // Adds a counter global and returns its index.
+  Index AppendCounter(Index loop);
+  // Increments |global| before the first expression of |exprs|.
+  void InsertIncrement(ExprList* exprs, Index global);
+  Index FindOrAppendType(const FuncSignature& sig);
+
+  Module* module_;
+  std::vector<ProfileCounter>* counters_;
+  // Of every counter, in counter order.
+  std::vector<Index> globals_;
+  ExprVisitor visitor_;
+  Index func_index_ = kInvalidIndex;
+  Index num_loops_ = 0;
+};
+
+Index ProfileInstrumenter::AppendCounter(Index loop) {
+  auto field = std::make_unique<GlobalModuleField>();
+  field->global.type = Type::I64;
+  field->global.mutable_ = true;
+  field->global.init_expr.push_back(std::make_unique<ConstExpr>(Const::I64(0)));
+  module_->AppendField(std::move(field));
+
+  Index global = module_->globals.size() - 1;
+  counters_->push_back(ProfileCounter{func_index_, loop});
+  globals_.push_back(global);
+  return global;
+}
+
+void ProfileInstrumenter::InsertIncrement(ExprList* exprs, Index global) {
+  exprs->push_front(std::make_unique<GlobalSetExpr>(Var(global)));
+  exprs->push_front(std::make_unique<BinaryExpr>(Opcode::I64Add));
+  exprs->push_front(std::make_unique<ConstExpr>(Const::I64(1)));
+  exprs->push_front(std::make_unique<GlobalGetExpr>(Var(global)));
+}
+
+Result ProfileInstrumenter::InstrumentFunc(Index func_index, Func* func) {
+  func_index_ = func_index;
+  num_loops_ = 0;
+  Index global = AppendCounter(kInvalidIndex);
+  // Bodies are visited before the entry increment goes in, so it isn't
+  // visited itself.
+  CHECK_RESULT(visitor_.VisitFunc(func));
+  InsertIncrement(&func->exprs, global);
+  return Result::Ok;
+}
+
+// The loop's own label is the target of its back edges, so the increment at
+// the top of its body runs once per iteration.
+Result ProfileInstrumenter::BeginLoopExpr(LoopExpr* expr) {
+  InsertIncrement(&expr->block.exprs, AppendCounter(num_loops_++));
+  return Result::Ok;
+}
+
+Index ProfileInstrumenter::FindOrAppendType(const FuncSignature& sig) {
+  for (Index i = 0; i < module_->types.size(); ++i) {
+    const FuncType* type = dyn_cast<FuncType>(module_->types[i]);
+    if (type && type->sig == sig) {
+      return i;
+    }
+  }
+  auto field = std::make_unique<TypeModuleField>();
+  auto type = std::make_unique<FuncType>();
+  type->sig = sig;
+  field->type = std::move(type);
+  module_->AppendField(std::move(field));
+  return module_->types.size() - 1;
+}
+
+void ProfileInstrumenter::AppendDumpFunc() {
+  const bool is_64 = module_->memories[0]->page_limits.is_64;
+  auto field = std::make_unique<FuncModuleField>();
+  Func& func = field->func;
+  func.decl.sig.param_types.push_back(is_64 ? Type::I64 : Type::I32);
+  func.decl.has_func_type = true;
+  func.decl.type_var = Var(FindOrAppendType(func.decl.sig));
+  for (size_t i = 0; i < globals_.size(); ++i) {
+    func.exprs.push_back(std::make_unique<LocalGetExpr>(Var(0)));
+    func.exprs.push_back(std::make_unique<GlobalGetExpr>(Var(globals_[i])));
+    func.exprs.push_back(std::make_unique<StoreExpr>(Opcode::I64Store, Var(0), 8, i * 8));
+  }
+  module_->AppendField(std::move(field));
+
+  auto export_field = std::make_unique<ExportModuleField>();
+  export_field->export_.name = kProfileDumpExport;
+  export_field->export_.kind = ExternalKind::Func;
+  export_field->export_.var = Var(module_->funcs.size() - 1);
+  module_->AppendField(std::move(export_field));
+}
+
+}  // end anonymous namespace
+
+Result InstrumentProfile(Module* module, std::vector<ProfileCounter>* counters, Errors* errors) {
+  if (module->memories.empty()) {
+    errors->emplace_back(ErrorLevel::Error, Location(),
+                         "profile instrumentation needs a memory for " + std::string(kProfileDumpExport));
+    return Result::Error;
+  }
+  if (module->export_bindings.FindIndex(kProfileDumpExport) != kInvalidIndex) {
+    errors->emplace_back(ErrorLevel::Error, Location(),
+                         "module already exports " + std::string(kProfileDumpExport));
+    return Result::Error;
+  }
+
+  counters->clear();
+  ProfileInstrumenter instrumenter(module, counters);
+  // The dump function is appended after the functions that are counted.
+  const Index num_funcs = module->funcs.size();
+  for (Index i = module->num_func_imports; i < num_funcs; ++i) {
+    CHECK_RESULT(instrumenter.InstrumentFunc(i, module->funcs[i]));
+  }
+  instrumenter.AppendDumpFunc();
+  return Result::Ok;
+}
+
+}  // namespace wabt
@@ -0,0 +1,34 @@
+#ifndef WABT_INSTRUMENT_PROFILE_H_
+#define WABT_INSTRUMENT_PROFILE_H_
+
+#include <vector>
+
+#include "wabt/common.h"
+#include "wabt/error.h"
+
+namespace wabt {
+
+struct Module;
+
+// Name of the export that InstrumentProfile adds.
+extern const char kProfileDumpExport[];
+
+// What a profile counter counts.
+struct ProfileCounter {
+  Index func;
+  // kInvalidIndex for the calls of |func|, otherwise the iterations of its
+  // loop with this ordinal, in the order the loops begin.
+  Index loop;
+};
+
+// Adds a mutable i64 global to |module| for every defined function, counting
+// its calls, and for every loop, counting its iterations; |counters| receives
+// what each one counts, in global order. Also adds the export
+// kProfileDumpExport, a function taking an address in memory 0 that stores
+// the counters there as consecutive little-endian i64s in the same order.
+// The module needs a memory for that.
+Result InstrumentProfile(struct Module*, std::vector<ProfileCounter>* counters, Errors*);
+
+}  // namespace wabt
+
+#endif /* WABT_INSTRUMENT_PROFILE_H_ */
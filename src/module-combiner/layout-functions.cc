@@ -0,0 +1,94 @@
+#include "layout-functions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include "wabt/ir.h"
+
+#include "remap-indices.h"
+
+namespace wabt {
+
+namespace {
+
+std::string_view StripSigil(std::string_view name) {
+  return !name.empty() && name[0] == '$' ? name.substr(1) : name;
+}
+
+}  // end anonymous namespace
+
+Result ReadFunctionProfile(const std::string& filename, FunctionProfile* profile) {
+  std::ifstream file(filename);
+  if (!file) {
+    fprintf(stderr, "unable to read profile %s\n", filename.c_str());
+    return Result::Error;
+  }
+
+  Result result = Result::Ok;
+  std::string line;
+  for (size_t line_number = 1; std::getline(file, line); ++line_number) {
+    std::istringstream fields(line);
+    std::string name;
+    if (!(fields >> name) || name[0] == '#') {
+      continue;
+    }
+    std::string count;
+    std::string extra;
+    char* end = nullptr;
+    errno = 0;
+    uint64_t value = 0;
+    if (fields >> count) {
+      value = strtoull(count.c_str(), &end, 10);
+    }
+    if (!end || *end != '\0' || errno || count[0] == '-' || fields >> extra) {
+      fprintf(stderr, "%s:%zu: expected a function name and a count\n", filename.c_str(),
+              line_number);
+      result = Result::Error;
+      continue;
+    }
+    (*profile)[std::string(StripSigil(name))] += value;
+  }
+  return result;
+}
+
+Result LayoutFunctions(Module* module, const FunctionProfile& profile) {
+  struct HotFunc {
+    Index index;
+    uint64_t count;
+  };
+  std::vector<HotFunc> hot;
+  for (Index i = module->num_func_imports; i < module->funcs.size(); ++i) {
+    auto it = profile.find(std::string(StripSigil(module->funcs[i]->name)));
+    if (it != profile.end() && it->second != 0) {
+      hot.push_back(HotFunc{i, it->second});
+    }
+  }
+  std::stable_sort(hot.begin(), hot.end(),
+                   [](const HotFunc& a, const HotFunc& b) { return a.count > b.count; });
+
+  ModuleIndexMap map;
+  map.funcs.assign(module->funcs.size(), kInvalidIndex);
+  for (Index i = 0; i < module->num_func_imports; ++i) {
+    map.funcs[i] = i;
+  }
+  Index next = module->num_func_imports;
+  for (const HotFunc& func : hot) {
+    map.funcs[func.index] = next++;
+  }
+  bool moved = false;
+  for (Index i = module->num_func_imports; i < module->funcs.size(); ++i) {
+    if (map.funcs[i] == kInvalidIndex) {
+      map.funcs[i] = next++;
+    }
+    moved |= map.funcs[i] != i;
+  }
+  return moved ? ApplyIndexMap(module, map) : Result::Ok;
+}
+
+}  // namespace wabt
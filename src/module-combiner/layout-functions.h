@@ -0,0 +1,34 @@
+#ifndef WABT_LAYOUT_FUNCTIONS_H_
+#define WABT_LAYOUT_FUNCTIONS_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+struct Module;
+
+// Function name, without a leading '$', to hit count.
+using FunctionProfile = std::unordered_map<std::string, uint64_t>;
+
+// Adds the counts of the profile |filename| to |profile|, one function per
+// line:
+//
+//   NAME COUNT
+//
+// Blank lines and lines starting with '#' are skipped, and counts of a name
+// that appears more than once are added up.
+Result ReadFunctionProfile(const std::string& filename, FunctionProfile* profile);
+
+// Moves the defined functions of |module| with a nonzero count in |profile|
+// in front of the other defined functions, hottest first, and remaps every
+// reference to them. Functions with equal counts, and the functions that
+// aren't in the profile, keep their order.
+Result LayoutFunctions(struct Module*, const FunctionProfile& profile);
+
+}  // namespace wabt
+
+#endif /* WABT_LAYOUT_FUNCTIONS_H_ */
@@ -0,0 +1,624 @@
+#include "merge-memories.h"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "wabt/cast.h"
+#include "wabt/expr-visitor.h"
+#include "wabt/ir.h"
+
+#include "remap-indices.h"
+
+namespace wabt {
+
+namespace {
+
+const uint64_t kMaxPages32 = 65536;
+const uint64_t kMaxAddress32 = uint64_t(1) << 32;
+
+// What the module does with one memory or table.
+struct SpaceUse {
+  bool eligible = true;
+  bool grows = false;
+  uint64_t max_offset = 0;
+};
+
+// Where a memory or table ends up in the one it is merged into.
+struct Placement {
+  bool merged = false;
+  // In pages for memories, in elements for tables.
+  uint64_t base = 0;
+  uint64_t size = 0;
+  // The memory that may grow, placed after all others.
+  bool top = false;
+};
+
+bool IsConstOffset(const ExprList& offset) {
+  return offset.size() == 1 && offset.front().type() == ExprType::Const
+         && cast<ConstExpr>(&offset.front())->const_.type() == Type::I32;
+}
+
+class UseScanner : public ExprVisitor::DelegateNop {
+ public:
+  UseScanner(Module* module, std::vector<SpaceUse>* memories, std::vector<SpaceUse>* tables)
+      : module_(module), memories_(memories), tables_(tables), visitor_(this) {}
+
+  Result VisitModule();
+
+  // Implementation of ExprVisitor::DelegateNop.
+  Result OnLoadExpr(LoadExpr* expr) override { return Access(expr); }
+  Result OnStoreExpr(StoreExpr* expr) override { return Access(expr); }
+  Result OnAtomicLoadExpr(AtomicLoadExpr* expr) override { return Access(expr); }
+  Result OnAtomicStoreExpr(AtomicStoreExpr* expr) override { return Access(expr); }
+  Result OnAtomicRmwExpr(AtomicRmwExpr* expr) override { return Access(expr); }
+  Result OnAtomicRmwCmpxchgExpr(AtomicRmwCmpxchgExpr* expr) override { return Access(expr); }
+  Result OnAtomicWaitExpr(AtomicWaitExpr* expr) override { return Access(expr); }
+  Result OnAtomicNotifyExpr(AtomicNotifyExpr* expr) override { return Access(expr); }
+  Result OnLoadSplatExpr(LoadSplatExpr* expr) override { return Access(expr); }
+  Result OnLoadZeroExpr(LoadZeroExpr* expr) override { return Access(expr); }
+  Result OnSimdLoadLaneExpr(SimdLoadLaneExpr* expr) override { return Access(expr); }
+  Result OnSimdStoreLaneExpr(SimdStoreLaneExpr* expr) override { return Access(expr); }
+  Result OnMemoryGrowExpr(MemoryGrowExpr* expr) override {
+    MemoryUse(expr->memidx)->grows = true;
+    return Result::Ok;
+  }
+  Result OnTableSetExpr(TableSetExpr* expr) override { return TableWrite(expr->var); }
+  Result OnTableGrowExpr(TableGrowExpr* expr) override { return TableWrite(expr->var); }
+  Result OnTableFillExpr(TableFillExpr* expr) override { return TableWrite(expr->var); }
+  Result OnTableCopyExpr(TableCopyExpr* expr) override {
+    CHECK_RESULT(TableWrite(expr->dst_table));
+    return TableWrite(expr->src_table);
+  }
+  Result OnTableInitExpr(TableInitExpr* expr) override { return TableWrite(expr->table_index); }
+
+ private:
+  template <typename T>
+  Result Access(T* expr) {
+    SpaceUse* use = MemoryUse(expr->memidx);
+    use->max_offset = std::max<uint64_t>(use->max_offset, expr->offset);
+    return Result::Ok;
+  }
+
+  SpaceUse* MemoryUse(const Var& var) {
+    Index index = module_->GetMemoryIndex(var);
+    return index < memories_->size() ? &(*memories_)[index] : &ignored_;
+  }
+
+  SpaceUse* TableUse(const Var& var) {
+    Index index = module_->GetTableIndex(var);
+    return index < tables_->size() ? &(*tables_)[index] : &ignored_;
+  }
+
+  Result TableWrite(const Var& var) {
+    TableUse(var)->eligible = false;
+    return Result::Ok;
+  }
+
+  Module* module_;
+  std::vector<SpaceUse>* memories_;
+  std::vector<SpaceUse>* tables_;
+  SpaceUse ignored_;
+  ExprVisitor visitor_;
+};
+
+Result UseScanner::VisitModule() {
+  for (Index i = 0; i < module_->num_memory_imports; ++i) {
+    (*memories_)[i].eligible = false;
+  }
+  for (Index i = 0; i < module_->num_table_imports; ++i) {
+    (*tables_)[i].eligible = false;
+  }
+  for (Index i = 0; i < module_->memories.size(); ++i) {
+    const Limits& limits = module_->memories[i]->page_limits;
+    if (limits.is_shared || limits.is_64) {
+      (*memories_)[i].eligible = false;
+    }
+  }
+
+  for (Func* func : module_->funcs) {
+    CHECK_RESULT(visitor_.VisitFunc(func));
+  }
+  for (const Export* export_ : module_->exports) {
+    if (export_->kind == ExternalKind::Memory) {
+      MemoryUse(export_->var)->eligible = false;
+    } else if (export_->kind == ExternalKind::Table) {
+      TableUse(export_->var)->eligible = false;
+    }
+  }
+  for (const DataSegment* segment : module_->data_segments) {
+    if (segment->kind == SegmentKind::Active && !IsConstOffset(segment->offset)) {
+      MemoryUse(segment->memory_var)->eligible = false;
+    }
+  }
+  for (const ElemSegment* segment : module_->elem_segments) {
+    if (segment->kind == SegmentKind::Active && !IsConstOffset(segment->offset)) {
+      TableUse(segment->table_var)->eligible = false;
+    }
+  }
+  return Result::Ok;
+}
+
+// Lays out |group|, old indices in increasing order, in |placements|. Members
+// that don't fit are dropped from |group|. Returns false if fewer than two
+// members are left.
+bool LayoutMemoryGroup(const Module* module,
+                       std::vector<SpaceUse>* uses,
+                       std::vector<Index>* group,
+                       std::vector<Placement>* placements) {
+  while (group->size() >= 2) {
+    Index grower = kInvalidIndex;
+    for (Index index : *group) {
+      if ((*uses)[index].grows) {
+        if (grower == kInvalidIndex) {
+          grower = index;
+        } else {
+          (*uses)[index].eligible = false;
+        }
+      }
+    }
+    group->erase(std::remove_if(group->begin(), group->end(),
+                                [&](Index index) { return !(*uses)[index].eligible; }),
+                 group->end());
+
+    uint64_t base = 0;
+    for (Index index : *group) {
+      if (index != grower) {
+        Placement& placement = (*placements)[index];
+        placement.base = base;
+        placement.size = module->memories[index]->page_limits.initial;
+        base += placement.size;
+      }
+    }
+    if (grower != kInvalidIndex) {
+      Placement& placement = (*placements)[grower];
+      placement.base = base;
+      placement.size = module->memories[grower]->page_limits.initial;
+      placement.top = true;
+    }
+
+    // Drop the first member whose accesses no longer fit in 32 bits.
+    Index misfit = kInvalidIndex;
+    for (Index index : *group) {
+      const Placement& placement = (*placements)[index];
+      if (placement.base + placement.size > kMaxPages32
+          || placement.base * WABT_PAGE_SIZE + (*uses)[index].max_offset >= kMaxAddress32) {
+        misfit = index;
+        break;
+      }
+    }
+    if (misfit == kInvalidIndex) {
+      return group->size() >= 2;
+    }
+    (*uses)[misfit].eligible = false;
+    group->erase(std::find(group->begin(), group->end(), misfit));
+  }
+  return false;
+}
+
+std::unique_ptr<Expr> I32Const(uint32_t value) {
+  return std::make_unique<ConstExpr>(Const::I32(value));
+}
+
+std::unique_ptr<Expr> LocalGet(Index index) {
+  return std::make_unique<LocalGetExpr>(Var(index));
+}
+
+std::unique_ptr<Expr> LocalSet(Index index) {
+  return std::make_unique<LocalSetExpr>(Var(index));
+}
+
+// Rewrites the accesses to merged memories and tables, in place. Memory and
+// table Vars are left for ApplyIndexMap.
+class AccessRebaser {
+ public:
+  AccessRebaser(Module* module,
+                const std::vector<Placement>& memories,
+                const std::vector<Placement>& tables)
+      : module_(module), memories_(memories), tables_(tables) {}
+
+  void VisitFunc(Func* func);
+  void RebaseOffset(ExprList* offset, uint64_t delta);
+
+ private:
+  void RewriteExprList(ExprList* exprs);
+  ExprList::iterator RewriteExpr(ExprList* exprs, ExprList::iterator it);
+
+  const Placement* MemoryPlacement(const Var& var) const;
+  const Placement* TablePlacement(const Var& var) const;
+  uint32_t MemoryBase(const Var& var) const;
+
+  template <typename T>
+  void RebaseMemArg(Expr* expr);
+
+  // Adds |delta| to the i32 in front of |pos|.
+  void InsertAdd(ExprList* exprs, ExprList::iterator pos, uint32_t delta);
+  Index Scratch(Index n);
+
+  Module* module_;
+  const std::vector<Placement>& memories_;
+  const std::vector<Placement>& tables_;
+  Func* func_ = nullptr;
+  Index scratch_ = kInvalidIndex;
+};
+
+const Placement* AccessRebaser::MemoryPlacement(const Var& var) const {
+  Index index = module_->GetMemoryIndex(var);
+  return index < memories_.size() && memories_[index].merged ? &memories_[index] : nullptr;
+}
+
+const Placement* AccessRebaser::TablePlacement(const Var& var) const {
+  Index index = module_->GetTableIndex(var);
+  return index < tables_.size() && tables_[index].merged ? &tables_[index] : nullptr;
+}
+
+uint32_t AccessRebaser::MemoryBase(const Var& var) const {
+  const Placement* placement = MemoryPlacement(var);
+  return placement ? static_cast<uint32_t>(placement->base * WABT_PAGE_SIZE) : 0;
+}
+
+template <typename T>
+void AccessRebaser::RebaseMemArg(Expr* expr) {
+  T* access = cast<T>(expr);
+  access->offset += MemoryBase(access->memidx);
+}
+
+void AccessRebaser::InsertAdd(ExprList* exprs, ExprList::iterator pos, uint32_t delta) {
+  exprs->insert(pos, I32Const(delta));
+  exprs->insert(pos, std::make_unique<BinaryExpr>(Opcode::I32Add));
+}
+
+// Two i32 locals per function hold the operands above the one that is
+// rebased.
+Index AccessRebaser::Scratch(Index n) {
+  if (scratch_ == kInvalidIndex) {
+    scratch_ = func_->GetNumParamsAndLocals();
+    func_->local_types.AppendDecl(Type::I32, 2);
+  }
+  return scratch_ + n;
+}
+
+void AccessRebaser::VisitFunc(Func* func) {
+  func_ = func;
+  scratch_ = kInvalidIndex;
+  RewriteExprList(&func->exprs);
+  func_ = nullptr;
+}
+
+void AccessRebaser::RebaseOffset(ExprList* offset, uint64_t delta) {
+  Const& value = cast<ConstExpr>(&offset->front())->const_;
+  value.set_u32(value.u32() + static_cast<uint32_t>(delta));
+}
+
+void AccessRebaser::RewriteExprList(ExprList* exprs) {
+  for (auto it = exprs->begin(); it != exprs->end(); ++it) {
+    it = RewriteExpr(exprs, it);
+  }
+}
+
+// Returns the last expression of whatever |it| was rewritten to.
+ExprList::iterator AccessRebaser::RewriteExpr(ExprList* exprs, ExprList::iterator it) {
+  Expr* expr = &*it;
+  auto next = std::next(it);
+  switch (expr->type()) {
+    case ExprType::Block:
+      RewriteExprList(&cast<BlockExpr>(expr)->block.exprs);
+      break;
+
+    case ExprType::Loop:
+      RewriteExprList(&cast<LoopExpr>(expr)->block.exprs);
+      break;
+
+    case ExprType::If:
+      RewriteExprList(&cast<IfExpr>(expr)->true_.exprs);
+      RewriteExprList(&cast<IfExpr>(expr)->false_);
+      break;
+
+    case ExprType::Try: {
+      TryExpr* try_ = cast<TryExpr>(expr);
+      RewriteExprList(&try_->block.exprs);
+      for (Catch& catch_ : try_->catches) {
+        RewriteExprList(&catch_.exprs);
+      }
+      break;
+    }
+
+    case ExprType::Load:
+      RebaseMemArg<LoadExpr>(expr);
+      break;
+    case ExprType::Store:
+      RebaseMemArg<StoreExpr>(expr);
+      break;
+    case ExprType::AtomicLoad:
+      RebaseMemArg<AtomicLoadExpr>(expr);
+      break;
+    case ExprType::AtomicStore:
+      RebaseMemArg<AtomicStoreExpr>(expr);
+      break;
+    case ExprType::AtomicRmw:
+      RebaseMemArg<AtomicRmwExpr>(expr);
+      break;
+    case ExprType::AtomicRmwCmpxchg:
+      RebaseMemArg<AtomicRmwCmpxchgExpr>(expr);
+      break;
+    case ExprType::AtomicWait:
+      RebaseMemArg<AtomicWaitExpr>(expr);
+      break;
+    case ExprType::AtomicNotify:
+      RebaseMemArg<AtomicNotifyExpr>(expr);
+      break;
+    case ExprType::LoadSplat:
+      RebaseMemArg<LoadSplatExpr>(expr);
+      break;
+    case ExprType::LoadZero:
+      RebaseMemArg<LoadZeroExpr>(expr);
+      break;
+    case ExprType::SimdLoadLane:
+      RebaseMemArg<SimdLoadLaneExpr>(expr);
+      break;
+    case ExprType::SimdStoreLane:
+      RebaseMemArg<SimdStoreLaneExpr>(expr);
+      break;
+
+    case ExprType::MemorySize: {
+      const Placement* placement = MemoryPlacement(cast<MemorySizeExpr>(expr)->memidx);
+      if (!placement) {
+        break;
+      }
+      if (!placement->top) {
+        // Only the top memory can grow, so the size of any other is fixed.
+        return exprs->insert(exprs->erase(it), I32Const(placement->size));
+      }
+      if (placement->base != 0) {
+        exprs->insert(next, I32Const(placement->base));
+        exprs->insert(next, std::make_unique<BinaryExpr>(Opcode::I32Sub));
+        return std::prev(next);
+      }
+      break;
+    }
+
+    case ExprType::MemoryGrow: {
+      const Placement* placement = MemoryPlacement(cast<MemoryGrowExpr>(expr)->memidx);
+      if (!placement || placement->base == 0) {
+        break;
+      }
+      // result == -1 ? -1 : result - base
+      Index result = Scratch(0);
+      exprs->insert(next, LocalSet(result));
+      exprs->insert(next, LocalGet(result));
+      exprs->insert(next, I32Const(placement->base));
+      exprs->insert(next, std::make_unique<BinaryExpr>(Opcode::I32Sub));
+      exprs->insert(next, I32Const(-1));
+      exprs->insert(next, LocalGet(result));
+      exprs->insert(next, I32Const(-1));
+      exprs->insert(next, std::make_unique<CompareExpr>(Opcode::I32Ne));
+      exprs->insert(next, std::make_unique<SelectExpr>(TypeVector()));
+      return std::prev(next);
+    }
+
+    case ExprType::MemoryFill:
+    case ExprType::MemoryInit: {
+      // [dest, value or source, size]
+      uint32_t base = expr->type() == ExprType::MemoryFill
+                          ? MemoryBase(cast<MemoryFillExpr>(expr)->memidx)
+                          : MemoryBase(cast<MemoryInitExpr>(expr)->memidx);
+      if (base == 0) {
+        break;
+      }
+      exprs->insert(it, LocalSet(Scratch(1)));
+      exprs->insert(it, LocalSet(Scratch(0)));
+      InsertAdd(exprs, it, base);
+      exprs->insert(it, LocalGet(Scratch(0)));
+      exprs->insert(it, LocalGet(Scratch(1)));
+      break;
+    }
+
+    case ExprType::MemoryCopy: {
+      // [dest, source, size]
+      MemoryCopyExpr* copy = cast<MemoryCopyExpr>(expr);
+      uint32_t dest_base = MemoryBase(copy->destmemidx);
+      uint32_t src_base = MemoryBase(copy->srcmemidx);
+      if (dest_base == 0 && src_base == 0) {
+        break;
+      }
+      exprs->insert(it, LocalSet(Scratch(1)));
+      if (src_base != 0) {
+        InsertAdd(exprs, it, src_base);
+      }
+      if (dest_base != 0) {
+        exprs->insert(it, LocalSet(Scratch(0)));
+        InsertAdd(exprs, it, dest_base);
+        exprs->insert(it, LocalGet(Scratch(0)));
+      }
+      exprs->insert(it, LocalGet(Scratch(1)));
+      break;
+    }
+
+    case ExprType::CallIndirect:
+    case ExprType::ReturnCallIndirect:
+    case ExprType::TableGet: {
+      // The element index is on top of the stack.
+      const Var& table = expr->type() == ExprType::CallIndirect
+                             ? cast<CallIndirectExpr>(expr)->table
+                             : expr->type() == ExprType::ReturnCallIndirect
+                                   ? cast<ReturnCallIndirectExpr>(expr)->table
+                                   : cast<TableGetExpr>(expr)->var;
+      const Placement* placement = TablePlacement(table);
+      if (placement && placement->base != 0) {
+        InsertAdd(exprs, it, placement->base);
+      }
+      break;
+    }
+
+    case ExprType::TableSize: {
+      // Merged tables never grow.
+      const Placement* placement = TablePlacement(cast<TableSizeExpr>(expr)->var);
+      if (placement) {
+        return exprs->insert(exprs->erase(it), I32Const(placement->size));
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+  return it;
+}
+
+// Old to new index of every entity when the merged ones are folded into the
+// first member of their group, which is |targets|[old index].
+std::vector<Index> BuildMergeMap(const std::vector<Index>& targets) {
+  std::vector<Index> map(targets.size());
+  Index next = 0;
+  for (Index i = 0; i < targets.size(); ++i) {
+    map[i] = targets[i] == i ? next++ : map[targets[i]];
+  }
+  return map;
+}
+
+}  // end anonymous namespace
+
+Result MergeMemories(Module* module, Index rw_memory_index, std::vector<Index>* memory_map) {
+  Index num_memories = module->memories.size();
+  std::vector<SpaceUse> memory_uses(num_memories);
+  std::vector<SpaceUse> table_uses(module->tables.size());
+  UseScanner scanner(module, &memory_uses, &table_uses);
+  CHECK_RESULT(scanner.VisitModule());
+
+  std::vector<Placement> placements(num_memories);
+  std::vector<Index> targets(num_memories);
+  for (Index i = 0; i < num_memories; ++i) {
+    targets[i] = i;
+  }
+
+  bool merged = false;
+  for (bool read_only : {true, false}) {
+    std::vector<Index> group;
+    for (Index i = 0; i < num_memories; ++i) {
+      if (memory_uses[i].eligible && (i < rw_memory_index) == read_only) {
+        group.push_back(i);
+      }
+    }
+    if (!LayoutMemoryGroup(module, &memory_uses, &group, &placements)) {
+      continue;
+    }
+
+    Index target = group.front();
+    Index grower = kInvalidIndex;
+    uint64_t pages = 0;
+    for (Index index : group) {
+      placements[index].merged = true;
+      targets[index] = target;
+      pages = std::max(pages, placements[index].base + placements[index].size);
+      if (placements[index].top) {
+        grower = index;
+      }
+    }
+
+    Limits limits;
+    limits.initial = pages;
+    if (grower == kInvalidIndex) {
+      limits.has_max = true;
+      limits.max = pages;
+    } else {
+      const Limits& grower_limits = module->memories[grower]->page_limits;
+      limits.has_max = grower_limits.has_max;
+      limits.max = std::min(placements[grower].base + grower_limits.max, kMaxPages32);
+    }
+    module->memories[target]->page_limits = limits;
+    merged = true;
+  }
+
+  if (!merged) {
+    *memory_map = BuildMergeMap(targets);
+    return Result::Ok;
+  }
+
+  std::vector<Placement> no_tables;
+  AccessRebaser rebaser(module, placements, no_tables);
+  for (Func* func : module->funcs) {
+    rebaser.VisitFunc(func);
+  }
+  for (DataSegment* segment : module->data_segments) {
+    Index index = module->GetMemoryIndex(segment->memory_var);
+    if (segment->kind == SegmentKind::Active && index < num_memories && placements[index].merged) {
+      rebaser.RebaseOffset(&segment->offset, placements[index].base * WABT_PAGE_SIZE);
+    }
+  }
+
+  ModuleIndexMap map;
+  map.memories = BuildMergeMap(targets);
+  *memory_map = map.memories;
+  return ApplyIndexMap(module, map);
+}
+
+Result MergeTables(Module* module) {
+  Index num_tables = module->tables.size();
+  std::vector<SpaceUse> memory_uses(module->memories.size());
+  std::vector<SpaceUse> table_uses(num_tables);
+  UseScanner scanner(module, &memory_uses, &table_uses);
+  CHECK_RESULT(scanner.VisitModule());
+
+  std::vector<Placement> placements(num_tables);
+  std::vector<Index> targets(num_tables);
+  for (Index i = 0; i < num_tables; ++i) {
+    targets[i] = i;
+  }
+
+  bool merged = false;
+  for (Index first = 0; first < num_tables; ++first) {
+    if (!table_uses[first].eligible || targets[first] != first) {
+      continue;
+    }
+    std::vector<Index> group = {first};
+    for (Index i = first + 1; i < num_tables; ++i) {
+      if (table_uses[i].eligible && targets[i] == i
+          && module->tables[i]->elem_type == module->tables[first]->elem_type) {
+        group.push_back(i);
+      }
+    }
+
+    uint64_t base = 0;
+    for (Index index : group) {
+      placements[index].base = base;
+      placements[index].size = module->tables[index]->elem_limits.initial;
+      base += placements[index].size;
+    }
+    if (group.size() < 2 || base >= kMaxAddress32) {
+      continue;
+    }
+
+    for (Index index : group) {
+      placements[index].merged = true;
+      targets[index] = first;
+    }
+    Limits& limits = module->tables[first]->elem_limits;
+    limits.initial = base;
+    limits.has_max = true;
+    limits.max = base;
+    merged = true;
+  }
+
+  if (!merged) {
+    return Result::Ok;
+  }
+
+  std::vector<Placement> no_memories;
+  AccessRebaser rebaser(module, no_memories, placements);
+  for (Func* func : module->funcs) {
+    rebaser.VisitFunc(func);
+  }
+  for (ElemSegment* segment : module->elem_segments) {
+    Index index = module->GetTableIndex(segment->table_var);
+    if (segment->kind == SegmentKind::Active && index < num_tables && placements[index].merged) {
+      rebaser.RebaseOffset(&segment->offset, placements[index].base);
+    }
+  }
+
+  ModuleIndexMap map;
+  map.tables = BuildMergeMap(targets);
+  return ApplyIndexMap(module, map);
+}
+
+}  // namespace wabt
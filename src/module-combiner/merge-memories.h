@@ -0,0 +1,37 @@
+#ifndef WABT_MERGE_MEMORIES_H_
+#define WABT_MERGE_MEMORIES_H_
+
+#include <vector>
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+struct Module;
+
+// Merges the memories of |module| into as few memories as possible by laying
+// them out one after another and rebasing every access by a constant. Only
+// defined, non-exported, non-shared 32-bit memories whose active data
+// segments have constant offsets are merged, and at most one memory per
+// merged memory may grow; it is placed last. Memories below |rw_memory_index|
+// are only merged with each other, so CheckAccessModule keeps treating them
+// as read-only. |memory_map| receives the new index of every old memory.
+//
+// Bounds checks then cover the merged memory rather than each original one:
+// a load, store, memory.copy or memory.fill past the end of an original
+// memory reads or writes the one placed after it instead of trapping. The
+// growing memory may only grow to 65536 pages minus its base, so its
+// memory.grow fails sooner than before.
+Result MergeMemories(struct Module*, Index rw_memory_index, std::vector<Index>* memory_map);
+
+// Merges defined, non-exported tables of the same element type the same way.
+// A table is only merged when its element segments have constant offsets and
+// it is only read, through call_indirect, return_call_indirect, table.get
+// and table.size. As with memories, an index past the end of an original
+// table then reaches an element of the table placed after it, so such a
+// call_indirect calls another table's function instead of trapping.
+Result MergeTables(struct Module*);
+
+}  // namespace wabt
+
+#endif /* WABT_MERGE_MEMORIES_H_ */
@@ -0,0 +1,514 @@
+#include "remap-indices.h"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "wabt/cast.h"
+#include "wabt/expr-visitor.h"
+#include "wabt/ir.h"
+
+namespace wabt {
+
+namespace {
+
+class IndexRemapper : public ExprVisitor::DelegateNop {
+ public:
+  IndexRemapper(Module* module, const ModuleIndexMap& map);
+
+  Result VisitModule();
+  Result VisitFunc(Func* func);
+
+  // Implementation of ExprVisitor::DelegateNop.
+  Result BeginBlockExpr(BlockExpr*) override;
+  Result BeginLoopExpr(LoopExpr*) override;
+  Result BeginIfExpr(IfExpr*) override;
+  Result BeginTryExpr(TryExpr*) override;
+  Result OnCallExpr(CallExpr*) override;
+  Result OnCallIndirectExpr(CallIndirectExpr*) override;
+  Result OnReturnCallExpr(ReturnCallExpr*) override;
+  Result OnReturnCallIndirectExpr(ReturnCallIndirectExpr*) override;
+  Result OnRefFuncExpr(RefFuncExpr*) override;
+  Result OnGlobalGetExpr(GlobalGetExpr*) override;
+  Result OnGlobalSetExpr(GlobalSetExpr*) override;
+  Result OnLoadExpr(LoadExpr*) override;
+  Result OnStoreExpr(StoreExpr*) override;
+  Result OnAtomicLoadExpr(AtomicLoadExpr*) override;
+  Result OnAtomicStoreExpr(AtomicStoreExpr*) override;
+  Result OnAtomicRmwExpr(AtomicRmwExpr*) override;
+  Result OnAtomicRmwCmpxchgExpr(AtomicRmwCmpxchgExpr*) override;
+  Result OnAtomicWaitExpr(AtomicWaitExpr*) override;
+  Result OnAtomicNotifyExpr(AtomicNotifyExpr*) override;
+  Result OnLoadSplatExpr(LoadSplatExpr*) override;
+  Result OnLoadZeroExpr(LoadZeroExpr*) override;
+  Result OnSimdLoadLaneExpr(SimdLoadLaneExpr*) override;
+  Result OnSimdStoreLaneExpr(SimdStoreLaneExpr*) override;
+  Result OnMemoryCopyExpr(MemoryCopyExpr*) override;
+  Result OnDataDropExpr(DataDropExpr*) override;
+  Result OnMemoryFillExpr(MemoryFillExpr*) override;
+  Result OnMemoryGrowExpr(MemoryGrowExpr*) override;
+  Result OnMemoryInitExpr(MemoryInitExpr*) override;
+  Result OnMemorySizeExpr(MemorySizeExpr*) override;
+  Result OnTableCopyExpr(TableCopyExpr*) override;
+  Result OnElemDropExpr(ElemDropExpr*) override;
+  Result OnTableInitExpr(TableInitExpr*) override;
+  Result OnTableGetExpr(TableGetExpr*) override;
+  Result OnTableSetExpr(TableSetExpr*) override;
+  Result OnTableGrowExpr(TableGrowExpr*) override;
+  Result OnTableSizeExpr(TableSizeExpr*) override;
+  Result OnTableFillExpr(TableFillExpr*) override;
+  Result OnCatchExpr(TryExpr*, Catch*) override;
+  Result OnThrowExpr(ThrowExpr*) override;
+
+ private:
+  Result Remap(const std::vector<Index>& map, Index index, Var* var);
+  Result RemapFuncVar(Var* var);
+  Result RemapTableVar(Var* var);
+  Result RemapMemoryVar(Var* var);
+  Result RemapGlobalVar(Var* var);
+  Result RemapTagVar(Var* var);
+  Result RemapTypeVar(Var* var);
+  Result RemapDataSegmentVar(Var* var);
+  Result RemapElemSegmentVar(Var* var);
+  Result RemapDecl(FuncDeclaration* decl);
+  Result VisitExport(Export* export_);
+  Result VisitElemSegment(ElemSegment* segment);
+  Result VisitDataSegment(DataSegment* segment);
+
+  Module* module_;
+  const ModuleIndexMap& map_;
+  ExprVisitor visitor_;
+};
+
+IndexRemapper::IndexRemapper(Module* module, const ModuleIndexMap& map)
+    : module_(module), map_(map), visitor_(this) {}
+
+Result IndexRemapper::Remap(const std::vector<Index>& map, Index index, Var* var) {
+  if (map.empty()) {
+    return Result::Ok;
+  }
+  if (index >= map.size()) {
+    return Result::Error;
+  }
+  var->set_index(map[index]);
+  return Result::Ok;
+}
+
+Result IndexRemapper::RemapFuncVar(Var* var) {
+  return Remap(map_.funcs, module_->GetFuncIndex(*var), var);
+}
+
+Result IndexRemapper::RemapTableVar(Var* var) {
+  return Remap(map_.tables, module_->GetTableIndex(*var), var);
+}
+
+Result IndexRemapper::RemapMemoryVar(Var* var) {
+  return Remap(map_.memories, module_->GetMemoryIndex(*var), var);
+}
+
+Result IndexRemapper::RemapGlobalVar(Var* var) {
+  return Remap(map_.globals, module_->GetGlobalIndex(*var), var);
+}
+
+Result IndexRemapper::RemapTagVar(Var* var) {
+  return Remap(map_.tags, module_->GetTagIndex(*var), var);
+}
+
+Result IndexRemapper::RemapTypeVar(Var* var) {
+  return Remap(map_.types, module_->GetFuncTypeIndex(*var), var);
+}
+
+Result IndexRemapper::RemapDataSegmentVar(Var* var) {
+  return Remap(map_.data_segments, module_->GetDataSegmentIndex(*var), var);
+}
+
+Result IndexRemapper::RemapElemSegmentVar(Var* var) {
+  return Remap(map_.elem_segments, module_->GetElemSegmentIndex(*var), var);
+}
+
+Result IndexRemapper::RemapDecl(FuncDeclaration* decl) {
+  if (decl->has_func_type) {
+    CHECK_RESULT(RemapTypeVar(&decl->type_var));
+  }
+  return Result::Ok;
+}
+
+Result IndexRemapper::BeginBlockExpr(BlockExpr* expr) {
+  return RemapDecl(&expr->block.decl);
+}
+
+Result IndexRemapper::BeginLoopExpr(LoopExpr* expr) {
+  return RemapDecl(&expr->block.decl);
+}
+
+Result IndexRemapper::BeginIfExpr(IfExpr* expr) {
+  return RemapDecl(&expr->true_.decl);
+}
+
+Result IndexRemapper::BeginTryExpr(TryExpr* expr) {
+  return RemapDecl(&expr->block.decl);
+}
+
+Result IndexRemapper::OnCallExpr(CallExpr* expr) {
+  return RemapFuncVar(&expr->var);
+}
+
+Result IndexRemapper::OnCallIndirectExpr(CallIndirectExpr* expr) {
+  CHECK_RESULT(RemapDecl(&expr->decl));
+  return RemapTableVar(&expr->table);
+}
+
+Result IndexRemapper::OnReturnCallExpr(ReturnCallExpr* expr) {
+  return RemapFuncVar(&expr->var);
+}
+
+Result IndexRemapper::OnReturnCallIndirectExpr(ReturnCallIndirectExpr* expr) {
+  CHECK_RESULT(RemapDecl(&expr->decl));
+  return RemapTableVar(&expr->table);
+}
+
+Result IndexRemapper::OnRefFuncExpr(RefFuncExpr* expr) {
+  return RemapFuncVar(&expr->var);
+}
+
+Result IndexRemapper::OnGlobalGetExpr(GlobalGetExpr* expr) {
+  return RemapGlobalVar(&expr->var);
+}
+
+Result IndexRemapper::OnGlobalSetExpr(GlobalSetExpr* expr) {
+  return RemapGlobalVar(&expr->var);
+}
+
+Result IndexRemapper::OnLoadExpr(LoadExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnStoreExpr(StoreExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnAtomicLoadExpr(AtomicLoadExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnAtomicStoreExpr(AtomicStoreExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnAtomicRmwExpr(AtomicRmwExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnAtomicRmwCmpxchgExpr(AtomicRmwCmpxchgExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnAtomicWaitExpr(AtomicWaitExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnAtomicNotifyExpr(AtomicNotifyExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnLoadSplatExpr(LoadSplatExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnLoadZeroExpr(LoadZeroExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnSimdLoadLaneExpr(SimdLoadLaneExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnSimdStoreLaneExpr(SimdStoreLaneExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnMemoryCopyExpr(MemoryCopyExpr* expr) {
+  CHECK_RESULT(RemapMemoryVar(&expr->srcmemidx));
+  return RemapMemoryVar(&expr->destmemidx);
+}
+
+Result IndexRemapper::OnDataDropExpr(DataDropExpr* expr) {
+  return RemapDataSegmentVar(&expr->var);
+}
+
+Result IndexRemapper::OnMemoryFillExpr(MemoryFillExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnMemoryGrowExpr(MemoryGrowExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnMemoryInitExpr(MemoryInitExpr* expr) {
+  CHECK_RESULT(RemapDataSegmentVar(&expr->var));
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnMemorySizeExpr(MemorySizeExpr* expr) {
+  return RemapMemoryVar(&expr->memidx);
+}
+
+Result IndexRemapper::OnTableCopyExpr(TableCopyExpr* expr) {
+  CHECK_RESULT(RemapTableVar(&expr->dst_table));
+  return RemapTableVar(&expr->src_table);
+}
+
+Result IndexRemapper::OnElemDropExpr(ElemDropExpr* expr) {
+  return RemapElemSegmentVar(&expr->var);
+}
+
+Result IndexRemapper::OnTableInitExpr(TableInitExpr* expr) {
+  CHECK_RESULT(RemapElemSegmentVar(&expr->segment_index));
+  return RemapTableVar(&expr->table_index);
+}
+
+Result IndexRemapper::OnTableGetExpr(TableGetExpr* expr) {
+  return RemapTableVar(&expr->var);
+}
+
+Result IndexRemapper::OnTableSetExpr(TableSetExpr* expr) {
+  return RemapTableVar(&expr->var);
+}
+
+Result IndexRemapper::OnTableGrowExpr(TableGrowExpr* expr) {
+  return RemapTableVar(&expr->var);
+}
+
+Result IndexRemapper::OnTableSizeExpr(TableSizeExpr* expr) {
+  return RemapTableVar(&expr->var);
+}
+
+Result IndexRemapper::OnTableFillExpr(TableFillExpr* expr) {
+  return RemapTableVar(&expr->var);
+}
+
+Result IndexRemapper::OnCatchExpr(TryExpr*, Catch* expr) {
+  if (!expr->IsCatchAll()) {
+    CHECK_RESULT(RemapTagVar(&expr->var));
+  }
+  return Result::Ok;
+}
+
+Result IndexRemapper::OnThrowExpr(ThrowExpr* expr) {
+  return RemapTagVar(&expr->var);
+}
+
+Result IndexRemapper::VisitFunc(Func* func) {
+  CHECK_RESULT(RemapDecl(&func->decl));
+  return visitor_.VisitFunc(func);
+}
+
+Result IndexRemapper::VisitExport(Export* export_) {
+  switch (export_->kind) {
+    case ExternalKind::Func:
+      return RemapFuncVar(&export_->var);
+    case ExternalKind::Table:
+      return RemapTableVar(&export_->var);
+    case ExternalKind::Memory:
+      return RemapMemoryVar(&export_->var);
+    case ExternalKind::Global:
+      return RemapGlobalVar(&export_->var);
+    case ExternalKind::Tag:
+      return RemapTagVar(&export_->var);
+  }
+  return Result::Ok;
+}
+
+Result IndexRemapper::VisitElemSegment(ElemSegment* segment) {
+  if (segment->kind == SegmentKind::Active) {
+    CHECK_RESULT(RemapTableVar(&segment->table_var));
+    CHECK_RESULT(visitor_.VisitExprList(segment->offset));
+  }
+  for (ExprList& elem_expr : segment->elem_exprs) {
+    CHECK_RESULT(visitor_.VisitExprList(elem_expr));
+  }
+  return Result::Ok;
+}
+
+Result IndexRemapper::VisitDataSegment(DataSegment* segment) {
+  if (segment->kind == SegmentKind::Active) {
+    CHECK_RESULT(RemapMemoryVar(&segment->memory_var));
+    CHECK_RESULT(visitor_.VisitExprList(segment->offset));
+  }
+  return Result::Ok;
+}
+
+Result IndexRemapper::VisitModule() {
+  for (Func* func : module_->funcs)
+    CHECK_RESULT(VisitFunc(func));
+  for (Tag* tag : module_->tags)
+    CHECK_RESULT(RemapDecl(&tag->decl));
+  for (Global* global : module_->globals)
+    CHECK_RESULT(visitor_.VisitExprList(global->init_expr));
+  for (Export* export_ : module_->exports)
+    CHECK_RESULT(VisitExport(export_));
+  for (ElemSegment* segment : module_->elem_segments)
+    CHECK_RESULT(VisitElemSegment(segment));
+  for (DataSegment* segment : module_->data_segments)
+    CHECK_RESULT(VisitDataSegment(segment));
+  for (Var* start : module_->starts)
+    CHECK_RESULT(RemapFuncVar(start));
+  return Result::Ok;
+}
+
+// Where a field goes in the rebuilt field list. Fields that define an
+// entity are grouped by index space and ordered by new index; all other
+// fields, imports included, keep their relative order in front of them.
+struct FieldPosition {
+  int space = 0;
+  Index index = 0;
+};
+
+// Returns false if the entity defined by |field| is dropped.
+bool GetFieldPosition(const ModuleField& field,
+                      const ModuleIndexMap& map,
+                      Index (&counts)[8],
+                      FieldPosition* position) {
+  const std::vector<Index>* space_map = nullptr;
+  int space = 0;
+  switch (field.type()) {
+    case ModuleFieldType::Func:
+      space_map = &map.funcs;
+      space = 1;
+      break;
+    case ModuleFieldType::Table:
+      space_map = &map.tables;
+      space = 2;
+      break;
+    case ModuleFieldType::Memory:
+      space_map = &map.memories;
+      space = 3;
+      break;
+    case ModuleFieldType::Global:
+      space_map = &map.globals;
+      space = 4;
+      break;
+    case ModuleFieldType::Tag:
+      space_map = &map.tags;
+      space = 5;
+      break;
+    case ModuleFieldType::Type:
+      space_map = &map.types;
+      space = 6;
+      break;
+    case ModuleFieldType::DataSegment:
+      space_map = &map.data_segments;
+      space = 7;
+      break;
+    case ModuleFieldType::ElemSegment:
+      space_map = &map.elem_segments;
+      space = 8;
+      break;
+    case ModuleFieldType::Import: {
+      // Imports come first in their index space and are never moved.
+      const Import* import = cast<ImportModuleField>(&field)->import.get();
+      switch (import->kind()) {
+        case ExternalKind::Func:
+          counts[0]++;
+          break;
+        case ExternalKind::Table:
+          counts[1]++;
+          break;
+        case ExternalKind::Memory:
+          counts[2]++;
+          break;
+        case ExternalKind::Global:
+          counts[3]++;
+          break;
+        case ExternalKind::Tag:
+          counts[4]++;
+          break;
+      }
+      return true;
+    }
+    default:
+      return true;
+  }
+
+  Index old_index = counts[space - 1]++;
+  position->space = space;
+  position->index = space_map->empty() ? old_index : (*space_map)[old_index];
+  return position->index != kInvalidIndex;
+}
+
+void ClearModuleFields(Module* module) {
+  module->funcs.clear();
+  module->globals.clear();
+  module->imports.clear();
+  module->exports.clear();
+  module->types.clear();
+  module->tables.clear();
+  module->elem_segments.clear();
+  module->memories.clear();
+  module->starts.clear();
+  module->data_segments.clear();
+  module->tags.clear();
+  module->num_tag_imports = 0;
+  module->num_func_imports = 0;
+  module->num_table_imports = 0;
+  module->num_memory_imports = 0;
+  module->num_global_imports = 0;
+  module->tag_bindings.clear();
+  module->func_bindings.clear();
+  module->global_bindings.clear();
+  module->export_bindings.clear();
+  module->type_bindings.clear();
+  module->table_bindings.clear();
+  module->memory_bindings.clear();
+  module->data_segment_bindings.clear();
+  module->elem_segment_bindings.clear();
+}
+
+}  // end anonymous namespace
+
+Result RemapIndices(Module* module, const ModuleIndexMap& map) {
+  IndexRemapper remapper(module, map);
+  return remapper.VisitModule();
+}
+
+Result ApplyIndexMap(Module* module, const ModuleIndexMap& map) {
+  CHECK_RESULT(RemapIndices(module, map));
+
+  std::vector<std::pair<FieldPosition, std::unique_ptr<ModuleField>>> fields;
+  std::vector<bool> placed[9];
+  Index counts[8] = {};
+  while (!module->fields.empty()) {
+    std::unique_ptr<ModuleField> field = module->fields.extract_front();
+    FieldPosition position;
+    if (!GetFieldPosition(*field, map, counts, &position)) {
+      continue;
+    }
+    if (position.space != 0) {
+      // Entities mapped onto an index that is already taken are merged into
+      // the first one.
+      std::vector<bool>& space_placed = placed[position.space];
+      if (position.index >= space_placed.size()) {
+        space_placed.resize(position.index + 1);
+      } else if (space_placed[position.index]) {
+        continue;
+      }
+      space_placed[position.index] = true;
+    }
+    fields.emplace_back(position, std::move(field));
+  }
+  std::stable_sort(fields.begin(), fields.end(), [](const auto& a, const auto& b) {
+    return a.first.space < b.first.space
+           || (a.first.space == b.first.space && a.first.index < b.first.index);
+  });
+
+  // AppendField rebuilds the index spaces, import counts and bindings.
+  ClearModuleFields(module);
+  for (auto& field : fields) {
+    module->AppendField(std::move(field.second));
+  }
+  return Result::Ok;
+}
+
+}  // namespace wabt
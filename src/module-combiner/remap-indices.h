@@ -0,0 +1,39 @@
+#ifndef WABT_REMAP_INDICES_H_
+#define WABT_REMAP_INDICES_H_
+
+#include <vector>
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+struct Module;
+
+// Old index to new index, one table per index space. An empty table leaves
+// that index space untouched.
+struct ModuleIndexMap {
+  std::vector<Index> funcs;
+  std::vector<Index> tables;
+  std::vector<Index> memories;
+  std::vector<Index> globals;
+  std::vector<Index> tags;
+  std::vector<Index> types;
+  std::vector<Index> data_segments;
+  std::vector<Index> elem_segments;
+};
+
+// Rewrites every Var of |module| that refers to a module-level entity to the
+// mapped index. Named Vars are looked up in |module| and become index Vars.
+// Labels and locals are function-local and are left alone.
+Result RemapIndices(struct Module*, const ModuleIndexMap&);
+
+// RemapIndices, then moves the fields of |module| so that every entity ends
+// up at its mapped index. Entities mapped to kInvalidIndex are dropped, so
+// nothing that is kept may refer to them, and entities mapped to the same
+// index as an earlier one are merged into it. Imports must map to
+// themselves.
+Result ApplyIndexMap(struct Module*, const ModuleIndexMap&);
+
+}  // namespace wabt
+
+#endif /* WABT_REMAP_INDICES_H_ */
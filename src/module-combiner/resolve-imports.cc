@@ -17,495 +17,413 @@
 #include "resolve-imports.h"
 
 #include <cassert>
+#include <algorithm>
+#include <cstdint>
 #include <cstdio>
-#include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "wabt/cast.h"
-#include "wabt/expr-visitor.h"
 #include "wabt/ir.h"
 
+#include "symbol-index.h"
+
 using namespace std;
 
 namespace wabt {
 
 namespace {
 
-class ImportResolver: public ExprVisitor::DelegateNop {
- public:
-  ImportResolver(unordered_map<string, string>* import_map);
-
-  Result VisitModule(Module* module);
-
-  // Implementation of ExprVisitor::DelegateNop.
-  Result BeginBlockExpr(BlockExpr*) override;
-  Result EndBlockExpr(BlockExpr*) override;
-  Result OnCallExpr(CallExpr*) override;
-  Result OnRefFuncExpr(RefFuncExpr*) override;
-  Result OnCallIndirectExpr(CallIndirectExpr*) override;
-  Result OnReturnCallExpr(ReturnCallExpr*) override;
-  Result OnReturnCallIndirectExpr(ReturnCallIndirectExpr*) override;
-  Result OnGlobalGetExpr(GlobalGetExpr*) override;
-  Result OnGlobalSetExpr(GlobalSetExpr*) override;
-  Result BeginIfExpr(IfExpr*) override;
-  Result EndIfExpr(IfExpr*) override;
-  Result OnLoadExpr(LoadExpr*) override;
-  Result BeginLoopExpr(LoopExpr*) override;
-  Result EndLoopExpr(LoopExpr*) override;
-  Result OnMemoryCopyExpr(MemoryCopyExpr*) override;
-  Result OnMemoryFillExpr(MemoryFillExpr*) override;
-  Result OnMemoryGrowExpr(MemoryGrowExpr*) override;
-  Result OnMemoryInitExpr(MemoryInitExpr*) override;
-  Result OnMemorySizeExpr(MemorySizeExpr*) override;
-  Result OnTableCopyExpr(TableCopyExpr*) override;
-  Result OnTableInitExpr(TableInitExpr*) override;
-  Result OnTableGetExpr(TableGetExpr*) override;
-  Result OnTableSetExpr(TableSetExpr*) override;
-  Result OnTableGrowExpr(TableGrowExpr*) override;
-  Result OnTableSizeExpr(TableSizeExpr*) override;
-  Result OnTableFillExpr(TableFillExpr*) override;
-  Result OnStoreExpr(StoreExpr*) override;
-  Result BeginTryExpr(TryExpr*) override;
-  Result EndTryExpr(TryExpr*) override;
-  Result OnCatchExpr(TryExpr*, Catch*) override;
-  Result OnThrowExpr(ThrowExpr*) override;
-
- private:
-  void PushLabel(const std::string& label);
-  void PopLabel();
-  void ResolveImportForVar(string_view name, Var* var);
-  Result ResolveImportForFuncVar(Var* var);
-  Result ResolveImportForGlobalVar(Var* var);
-  Result ResolveImportForTableVar(Var* var);
-  Result ResolveImportForMemoryVar(Var* var);
-  Result ResolveImportForTagVar(Var* var);
-  Result VisitFunc(Index func_index, Func* func);
-  Result VisitGlobal(Global* global);
-  Result VisitTag(Tag* tag);
-  Result VisitExport(Index export_index, Export* export_);
-  Result VisitElemSegment(Index elem_segment_index, ElemSegment* segment);
-  Result VisitDataSegment(Index data_segment_index, DataSegment* segment);
-  Result VisitStart(Var* start_var);
-
-  Module* module_ = nullptr;
-  Func* current_func_ = nullptr;
-  unordered_map<string, string>* import_map_;
-  ExprVisitor visitor_;
-  std::vector<std::string> labels_;
-};
-
-ImportResolver::ImportResolver(unordered_map<string, string>* import_map) : import_map_(import_map),
-                                                                            visitor_(this) {}
-
-void ImportResolver::PushLabel(const std::string& label) {
-  labels_.push_back(label);
-}
-
-void ImportResolver::PopLabel() {
-  labels_.pop_back();
-}
-
-void ImportResolver::ResolveImportForVar(string_view name, Var* var) {
-  if (var->is_name()) {
-    assert(name == var->name());
+Result ImportMapConstructor(const vector<Module*>& modules,
+                            const SymbolIndex& symbols,
+                            Index module_index,
+                            ModuleImportMap* imports,
+                            Errors* errors) {
+  Module* module_ = modules[module_index];
+  imports->funcs.assign(module_->num_func_imports, ImportTarget());
+  imports->tables.assign(module_->num_table_imports, ImportTarget());
+  imports->memories.assign(module_->num_memory_imports, ImportTarget());
+  imports->globals.assign(module_->num_global_imports, ImportTarget());
+  imports->tags.assign(module_->num_tag_imports, ImportTarget());
+
+  vector<uint64_t> hashes;
+  hashes.reserve(module_->imports.size());
+  for (const Import* import_ : module_->imports) {
+    hashes.push_back(SymbolIndex::Hash(import_->module_name, import_->field_name));
+    symbols.Prefetch(hashes.back());
   }
 
-  if (!name.empty()) { 
-    if (import_map_->find({name.begin(), name.end()}) != import_map_->end()) {
-      var->set_name(import_map_->at({name.begin(), name.end()}));
-    } else {
-      var->set_name(name);
+  Result result = Result::Ok;
+  Index num_imports[kExternalKindCount] = {};
+  for (size_t i = 0; i < module_->imports.size(); ++i) {
+    const Import* import_ = module_->imports[i];
+    Index import_index = num_imports[static_cast<int>(import_->kind())]++;
+    if (!symbols.HasModule(import_->module_name, module_index)) {
+      continue;
     }
-  }
 
-  return;
-}
+    const Symbol* symbol = symbols.Find(hashes[i], import_->module_name, import_->field_name);
+    const char* error = nullptr;
+    if (!symbol || symbol->module == module_index) {
+      error = "no module exports";
+    } else if (symbol->kind != import_->kind()) {
+      error = "export of a different kind for";
+    }
+    if (error) {
+      errors->emplace_back(ErrorLevel::Error, Location(),
+                           std::string(error) + " \"" + import_->module_name + "."
+                               + import_->field_name + "\" imported by " + module_->name);
+      result = Result::Error;
+      continue;
+    }
 
-Result ImportResolver::ResolveImportForFuncVar(Var* var) {
-  Func* func = module_->GetFunc(*var);
-  if (!func) {
-    return Result::Error;
+    ImportTarget& target = imports->Get(import_->kind())[import_index];
+    target.module = symbol->module;
+    target.index = symbol->index;
   }
-  ResolveImportForVar(func->name, var);
-  return Result::Ok;
+  return result;
 }
 
-Result ImportResolver::ResolveImportForGlobalVar(Var* var) {
-  Global* global = module_->GetGlobal(*var);
-  if (!global) {
-    return Result::Error;
+// An export can itself be an import from a third module. Follow such chains
+// so that every target is the entity that is finally defined.
+void ImportMapFlatten(ImportMap* import_map) {
+  const ExternalKind kinds[] = {ExternalKind::Func, ExternalKind::Table, ExternalKind::Memory,
+                                ExternalKind::Global, ExternalKind::Tag};
+  for (ModuleImportMap& imports : *import_map) {
+    for (ExternalKind kind : kinds) {
+      for (ImportTarget& target : imports.Get(kind)) {
+        size_t hops = 0;
+        while (target.is_resolved() && hops++ < import_map->size()) {
+          const vector<ImportTarget>& next = (*import_map)[target.module].Get(kind);
+          if (target.index >= next.size() || !next[target.index].is_resolved()) {
+            break;
+          }
+          target = next[target.index];
+        }
+      }
+    }
   }
-  ResolveImportForVar(global->name, var);
-  return Result::Ok;
 }
 
-Result ImportResolver::ResolveImportForTableVar(Var* var) {
-  Table* table = module_->GetTable(*var);
-  if (!table) {
-    return Result::Error;
+// The name of entity |index| of |kind| in |module|, nullptr if there is no
+// such entity.
+std::string* EntityName(Module* module, ExternalKind kind, Index index) {
+  switch (kind) {
+    case ExternalKind::Func:
+      return index < module->funcs.size() ? &module->funcs[index]->name : nullptr;
+    case ExternalKind::Table:
+      return index < module->tables.size() ? &module->tables[index]->name : nullptr;
+    case ExternalKind::Memory:
+      return index < module->memories.size() ? &module->memories[index]->name : nullptr;
+    case ExternalKind::Global:
+      return index < module->globals.size() ? &module->globals[index]->name : nullptr;
+    case ExternalKind::Tag:
+      return index < module->tags.size() ? &module->tags[index]->name : nullptr;
   }
-  ResolveImportForVar(table->name, var);
-  return Result::Ok;
+  return nullptr;
 }
 
-Result ImportResolver::ResolveImportForMemoryVar(Var* var) {
-  Memory* memory = module_->GetMemory(*var);
-  if (!memory) {
-    return Result::Error;
+BindingHash& Bindings(Module* module, ExternalKind kind) {
+  switch (kind) {
+    case ExternalKind::Func:
+      return module->func_bindings;
+    case ExternalKind::Table:
+      return module->table_bindings;
+    case ExternalKind::Memory:
+      return module->memory_bindings;
+    case ExternalKind::Global:
+      return module->global_bindings;
+    case ExternalKind::Tag:
+      return module->tag_bindings;
   }
-  ResolveImportForVar(memory->name, var);
-  return Result::Ok;
+  WABT_UNREACHABLE;
 }
 
-Result ImportResolver::ResolveImportForTagVar(Var* var) {
-  Tag* tag = module_->GetTag(*var);
-  if (!tag) {
-    return Result::Error;
+// Whether an entity with |actual| limits can be imported as |expected|.
+bool LimitsMatch(const Limits& expected, const Limits& actual) {
+  if (expected.is_64 != actual.is_64 || expected.is_shared != actual.is_shared) {
+    return false;
   }
-  ResolveImportForVar(tag->name, var);
-  return Result::Ok;
-}
-
-Result ImportResolver::BeginBlockExpr(BlockExpr* expr) {
-  PushLabel(expr->block.label);
-  return Result::Ok;
-}
-
-Result ImportResolver::EndBlockExpr(BlockExpr* expr) {
-  PopLabel();
-  return Result::Ok;
-}
-
-Result ImportResolver::BeginLoopExpr(LoopExpr* expr) {
-  PushLabel(expr->block.label);
-  return Result::Ok;
-}
-
-Result ImportResolver::EndLoopExpr(LoopExpr* expr) {
-  PopLabel();
-  return Result::Ok;
-}
-
-Result ImportResolver::OnMemoryCopyExpr(MemoryCopyExpr* expr) {
-  CHECK_RESULT(ResolveImportForMemoryVar(&expr->srcmemidx));
-  CHECK_RESULT(ResolveImportForMemoryVar(&expr->destmemidx));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnMemoryFillExpr(MemoryFillExpr* expr) {
-  CHECK_RESULT(ResolveImportForMemoryVar(&expr->memidx));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnMemoryGrowExpr(MemoryGrowExpr* expr) {
-  CHECK_RESULT(ResolveImportForMemoryVar(&expr->memidx));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnMemoryInitExpr(MemoryInitExpr* expr)  {
-  CHECK_RESULT(ResolveImportForMemoryVar(&expr->memidx));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnMemorySizeExpr(MemorySizeExpr* expr) {
-  CHECK_RESULT(ResolveImportForMemoryVar(&expr->memidx));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnTableCopyExpr(TableCopyExpr* expr) {
-  CHECK_RESULT(ResolveImportForTableVar(&expr->dst_table));
-  CHECK_RESULT(ResolveImportForTableVar(&expr->src_table));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnTableInitExpr(TableInitExpr* expr)  {
-  CHECK_RESULT(ResolveImportForTableVar(&expr->table_index));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnTableGetExpr(TableGetExpr* expr)  {
-  CHECK_RESULT(ResolveImportForTableVar(&expr->var));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnTableSetExpr(TableSetExpr* expr)  {
-  CHECK_RESULT(ResolveImportForTableVar(&expr->var));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnTableGrowExpr(TableGrowExpr* expr)  {
-  CHECK_RESULT(ResolveImportForTableVar(&expr->var));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnTableSizeExpr(TableSizeExpr* expr)  {
-  CHECK_RESULT(ResolveImportForTableVar(&expr->var));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnTableFillExpr(TableFillExpr* expr)  {
-  CHECK_RESULT(ResolveImportForTableVar(&expr->var));
-  return Result::Ok;
-}
-
-Result ImportResolver::OnStoreExpr(StoreExpr* expr) {
-  CHECK_RESULT(ResolveImportForMemoryVar(&expr->memidx));
-  return Result::Ok;
-}
-
-Result ImportResolver::BeginTryExpr(TryExpr* expr) {
-  PushLabel(expr->block.label);
-  return Result::Ok;
-}
-
-Result ImportResolver::EndTryExpr(TryExpr*) {
-  PopLabel();
-  return Result::Ok;
+  if (actual.initial < expected.initial) {
+    return false;
+  }
+  return !expected.has_max || (actual.has_max && actual.max <= expected.max);
 }
 
-Result ImportResolver::OnCatchExpr(TryExpr*, Catch* expr) {
-  if (!expr->IsCatchAll()) {
-    CHECK_RESULT(ResolveImportForTagVar(&expr->var));
+uint64_t HashTypes(uint64_t hash, const TypeVector& types) {
+  hash = (hash ^ types.size()) * 0x100000001b3ull;
+  for (Type type : types) {
+    hash = (hash ^ static_cast<uint32_t>(static_cast<Type::Enum>(type))) * 0x100000001b3ull;
   }
-  return Result::Ok;
+  return hash;
 }
 
-Result ImportResolver::OnThrowExpr(ThrowExpr* expr) {
-  CHECK_RESULT(ResolveImportForTagVar(&expr->var));
-  return Result::Ok;
+uint64_t HashSignature(const FuncSignature& sig) {
+  return HashTypes(HashTypes(0xcbf29ce484222325ull, sig.param_types), sig.result_types);
 }
 
-Result ImportResolver::OnCallExpr(CallExpr* expr) {
-  CHECK_RESULT(ResolveImportForFuncVar(&expr->var));
-  return Result::Ok;
-}
+// Structural hashes of the function types of one module, so a signature
+// that names its type is compared with a single integer comparison.
+class SignatureHashes {
+ public:
+  explicit SignatureHashes(const Module* module) : module_(module) {
+    for (const TypeEntry* type : module->types) {
+      const FuncType* func_type = dyn_cast<FuncType>(type);
+      hashes_.push_back(func_type ? HashSignature(func_type->sig) : 0);
+    }
+  }
 
-Result ImportResolver::OnRefFuncExpr(RefFuncExpr* expr) {
-  CHECK_RESULT(ResolveImportForFuncVar(&expr->var));
-  return Result::Ok;
-}
+  uint64_t Get(const FuncDeclaration& decl) const {
+    if (decl.has_func_type) {
+      Index index = module_->GetFuncTypeIndex(decl.type_var);
+      if (index < hashes_.size()) {
+        return hashes_[index];
+      }
+    }
+    return HashSignature(decl.sig);
+  }
 
-Result ImportResolver::OnCallIndirectExpr(CallIndirectExpr* expr) {
-  CHECK_RESULT(ResolveImportForTableVar(&expr->table));
-  return Result::Ok;
-}
+ private:
+  const Module* module_;
+  std::vector<uint64_t> hashes_;
+};
 
-Result ImportResolver::OnReturnCallExpr(ReturnCallExpr* expr) {
-  CHECK_RESULT(ResolveImportForFuncVar(&expr->var));
-  return Result::Ok;
+std::string DescribeTypes(const TypeVector& types) {
+  std::string out = "(";
+  for (size_t i = 0; i < types.size(); ++i) {
+    out += (i ? ", " : "") + std::string(types[i].GetName());
+  }
+  return out + ")";
 }
 
-Result ImportResolver::OnReturnCallIndirectExpr(ReturnCallIndirectExpr* expr) {
-  CHECK_RESULT(ResolveImportForTableVar(&expr->table));
-  return Result::Ok;
+std::string DescribeSignature(const FuncSignature& sig) {
+  return DescribeTypes(sig.param_types) + " -> " + DescribeTypes(sig.result_types);
 }
 
-Result ImportResolver::OnGlobalGetExpr(GlobalGetExpr* expr) {
-  CHECK_RESULT(ResolveImportForGlobalVar(&expr->var));
-  return Result::Ok;
+std::string DescribeLimits(const Limits& limits) {
+  std::string out = "initial " + std::to_string(limits.initial);
+  if (limits.has_max) {
+    out += ", max " + std::to_string(limits.max);
+  }
+  if (limits.is_64) {
+    out += ", 64-bit";
+  }
+  if (limits.is_shared) {
+    out += ", shared";
+  }
+  return out;
 }
 
-Result ImportResolver::BeginIfExpr(IfExpr* expr) {
-  PushLabel(expr->true_.label);
-  return Result::Ok;
+std::string DescribeGlobal(const Global& global) {
+  return std::string(global.mutable_ ? "mut " : "") + std::string(global.type.GetName());
 }
 
-Result ImportResolver::EndIfExpr(IfExpr* expr) {
-  PopLabel();
-  return Result::Ok;
-}
+// Why an import can't be given its target, with what each side declares.
+struct ImportMismatch {
+  const char* what = nullptr;
+  std::string expected;
+  std::string actual;
+};
 
-Result ImportResolver::OnLoadExpr(LoadExpr* expr) {
-  CHECK_RESULT(ResolveImportForMemoryVar(&expr->memidx));
-  return Result::Ok;
-}
+bool SignaturesMatch(const FuncDeclaration& expected,
+                     const SignatureHashes& expected_hashes,
+                     const FuncDeclaration& actual,
+                     const SignatureHashes& actual_hashes) {
+  return expected_hashes.Get(expected) == actual_hashes.Get(actual) && expected.sig == actual.sig;
+}
+
+// Fills |mismatch| and returns true unless entity |index| of |module| may be
+// imported as |import_|.
+bool FindImportMismatch(const Import* import_,
+                        const SignatureHashes& import_hashes,
+                        const Module* module,
+                        const SignatureHashes& module_hashes,
+                        Index index,
+                        ImportMismatch* mismatch) {
+  switch (import_->kind()) {
+    case ExternalKind::Func: {
+      if (index >= module->funcs.size()) {
+        mismatch->what = "function index out of range";
+        return true;
+      }
+      const FuncDeclaration& expected = cast<FuncImport>(import_)->func.decl;
+      const FuncDeclaration& actual = module->funcs[index]->decl;
+      if (SignaturesMatch(expected, import_hashes, actual, module_hashes)) {
+        return false;
+      }
+      *mismatch = {"function signature mismatch", DescribeSignature(expected.sig),
+                   DescribeSignature(actual.sig)};
+      return true;
+    }
 
-Result ImportResolver::OnGlobalSetExpr(GlobalSetExpr* expr) {
-  CHECK_RESULT(ResolveImportForGlobalVar(&expr->var));
-  return Result::Ok;
-}
+    case ExternalKind::Table: {
+      if (index >= module->tables.size()) {
+        mismatch->what = "table index out of range";
+        return true;
+      }
+      const Table& expected = cast<TableImport>(import_)->table;
+      const Table* actual = module->tables[index];
+      if (expected.elem_type != actual->elem_type) {
+        *mismatch = {"table element type mismatch", std::string(expected.elem_type.GetName()),
+                     std::string(actual->elem_type.GetName())};
+        return true;
+      }
+      if (LimitsMatch(expected.elem_limits, actual->elem_limits)) {
+        return false;
+      }
+      *mismatch = {"table limits mismatch", DescribeLimits(expected.elem_limits),
+                   DescribeLimits(actual->elem_limits)};
+      return true;
+    }
 
-Result ImportResolver::VisitFunc(Index func_index, Func* func) {
-  current_func_ = func;
+    case ExternalKind::Memory: {
+      if (index >= module->memories.size()) {
+        mismatch->what = "memory index out of range";
+        return true;
+      }
+      const Limits& expected = cast<MemoryImport>(import_)->memory.page_limits;
+      const Limits& actual = module->memories[index]->page_limits;
+      if (LimitsMatch(expected, actual)) {
+        return false;
+      }
+      *mismatch = {"memory limits mismatch", DescribeLimits(expected), DescribeLimits(actual)};
+      return true;
+    }
 
-  CHECK_RESULT(visitor_.VisitFunc(func));
-  current_func_ = nullptr;
-  return Result::Ok;
-}
+    case ExternalKind::Global: {
+      if (index >= module->globals.size()) {
+        mismatch->what = "global index out of range";
+        return true;
+      }
+      const Global& expected = cast<GlobalImport>(import_)->global;
+      const Global* actual = module->globals[index];
+      if (expected.type == actual->type && expected.mutable_ == actual->mutable_) {
+        return false;
+      }
+      *mismatch = {expected.type != actual->type ? "global type mismatch" : "global mutability mismatch",
+                   DescribeGlobal(expected), DescribeGlobal(*actual)};
+      return true;
+    }
 
-Result ImportResolver::VisitGlobal(Global* global) {
-  CHECK_RESULT(visitor_.VisitExprList(global->init_expr));
-  return Result::Ok;
+    case ExternalKind::Tag: {
+      if (index >= module->tags.size()) {
+        mismatch->what = "tag index out of range";
+        return true;
+      }
+      const FuncDeclaration& expected = cast<TagImport>(import_)->tag.decl;
+      const FuncDeclaration& actual = module->tags[index]->decl;
+      if (SignaturesMatch(expected, import_hashes, actual, module_hashes)) {
+        return false;
+      }
+      *mismatch = {"tag signature mismatch", DescribeSignature(expected.sig),
+                   DescribeSignature(actual.sig)};
+      return true;
+    }
+  }
+  return false;
 }
 
-Result ImportResolver::VisitTag(Tag* tag) {
-  return Result::Ok;
-}
+}  // end anonymous namespace
 
-Result ImportResolver::VisitExport(Index export_index, Export* export_) {
-  switch (export_->kind) {
+vector<ImportTarget>& ModuleImportMap::Get(ExternalKind kind) {
+  switch (kind) {
     case ExternalKind::Func:
-      ResolveImportForFuncVar(&export_->var);
-      break;
-
+      return funcs;
     case ExternalKind::Table:
-      ResolveImportForTableVar(&export_->var);
-      break;
-
+      return tables;
     case ExternalKind::Memory:
-      ResolveImportForMemoryVar(&export_->var);
-      break;
-
+      return memories;
     case ExternalKind::Global:
-      ResolveImportForGlobalVar(&export_->var);
-      break;
-
+      return globals;
     case ExternalKind::Tag:
-      ResolveImportForTagVar(&export_->var);
-      break;
+      return tags;
   }
-  return Result::Ok;
+  WABT_UNREACHABLE;
 }
 
-Result ImportResolver::VisitElemSegment(Index elem_segment_index,
-                                     ElemSegment* segment) {
-  CHECK_RESULT(ResolveImportForTableVar(&segment->table_var));
-  CHECK_RESULT(visitor_.VisitExprList(segment->offset));
-  for (ExprList& elem_expr : segment->elem_exprs) {
-    Expr* expr = &elem_expr.front();
-    if (expr->type() == ExprType::RefFunc) {
-      CHECK_RESULT(ResolveImportForFuncVar(&cast<RefFuncExpr>(expr)->var));
-    }
-  }
-  return Result::Ok;
+const vector<ImportTarget>& ModuleImportMap::Get(ExternalKind kind) const {
+  return const_cast<ModuleImportMap*>(this)->Get(kind);
 }
 
-Result ImportResolver::VisitDataSegment(Index data_segment_index,
-                                     DataSegment* segment) {
-  CHECK_RESULT(ResolveImportForMemoryVar(&segment->memory_var));
-  CHECK_RESULT(visitor_.VisitExprList(segment->offset));
+Result BuildImportMap(const vector<Module*>& modules, ImportMap* import_map, Errors* errors) {
+  SymbolIndex symbols;
+  Result result = symbols.Build(modules, errors);
+  import_map->assign(modules.size(), ModuleImportMap());
+  for (Index i = 0; i < modules.size(); ++i) {
+    result |= ImportMapConstructor(modules, symbols, i, &(*import_map)[i], errors);
+  }
+  CHECK_RESULT(result);
+  ImportMapFlatten(import_map);
   return Result::Ok;
 }
 
-Result ImportResolver::VisitStart(Var* start_var) {
-  CHECK_RESULT(ResolveImportForFuncVar(start_var));
-  return Result::Ok;
-}
+Result CheckImportTargets(const vector<Module*>& modules, const ImportMap& import_map, Errors* errors) {
+  vector<SignatureHashes> hashes;
+  hashes.reserve(modules.size());
+  for (const Module* module : modules) {
+    hashes.emplace_back(module);
+  }
 
-Result ImportResolver::VisitModule(Module* module) {
-  module_ = module;
-  for (size_t i = 0; i < module->funcs.size(); ++i)
-    CHECK_RESULT(VisitFunc(i, module->funcs[i]));
-  for (size_t i = 0; i < module->globals.size(); ++i)
-    CHECK_RESULT(VisitGlobal(module->globals[i]));
-  for (size_t i = 0; i < module->tags.size(); ++i)
-    CHECK_RESULT(VisitTag(module->tags[i]));
-  for (size_t i = 0; i < module->exports.size(); ++i)
-    CHECK_RESULT(VisitExport(i, module->exports[i]));
-  for (size_t i = 0; i < module->elem_segments.size(); ++i)
-    CHECK_RESULT(VisitElemSegment(i, module->elem_segments[i]));
-  for (size_t i = 0; i < module->data_segments.size(); ++i)
-    CHECK_RESULT(VisitDataSegment(i, module->data_segments[i]));
-  for (size_t i = 0; i < module->starts.size(); ++i)
-    CHECK_RESULT(VisitStart(module->starts[i]));
-  module_ = nullptr;
-  return Result::Ok;
+  Result result = Result::Ok;
+  for (Index m = 0; m < modules.size(); ++m) {
+    Index num_imports[kExternalKindCount] = {};
+    for (const Import* import_ : modules[m]->imports) {
+      Index import_index = num_imports[static_cast<int>(import_->kind())]++;
+      const ImportTarget& target = import_map[m].Get(import_->kind())[import_index];
+      if (!target.is_resolved()) {
+        continue;
+      }
+      const Module* exporter = modules[target.module];
+      ImportMismatch mismatch;
+      if (!FindImportMismatch(import_, hashes[m], exporter, hashes[target.module], target.index,
+                              &mismatch)) {
+        continue;
+      }
+      std::string message = std::string(mismatch.what) + ": \"" + import_->module_name + "."
+                            + import_->field_name + "\" imported by " + modules[m]->name;
+      if (!mismatch.expected.empty()) {
+        message += " as " + mismatch.expected + " is " + mismatch.actual + " in " + exporter->name;
+      } else {
+        message += " is defined by " + exporter->name;
+      }
+      errors->emplace_back(ErrorLevel::Error, Location(), message);
+      result = Result::Error;
+    }
+  }
+  return result;
 }
 
-void ImportMapConstructor(Module* module_, Module* libmodule, unordered_map<string, string>* import_map) {
-  for (Import* import_ : module_->imports) {
-    if (import_->module_name == libmodule->name) {
-      string field_name = import_->field_name;
-      string name;
-      
-      // Grab the name of import from import object
-      switch (import_->kind()) {
-        case ExternalKind::Func: {
-          Func& func = cast<FuncImport>(import_)->func;
-          name = func.name;
-          break;
-        }
-
-        case ExternalKind::Table: {
-          Table& table = cast<TableImport>(import_)->table;
-          name = table.name;
-          break;
-        }
-
-        case ExternalKind::Memory: {
-          Memory& memory = cast<MemoryImport>(import_)->memory;
-          name = memory.name;
-          break;
-        }
-
-        case ExternalKind::Global: {
-          Global& global = cast<GlobalImport>(import_)->global;
-          name = global.name;
-          break;
-        }
-
-        case ExternalKind::Tag: {
-          Tag& tag = cast<TagImport>(import_)->tag;
-          name = tag.name;
-          break;
-        }
+Result ResolveImports(const vector<Module*>& modules, const ImportMap& import_map) {
+  for (Index m = 0; m < modules.size(); ++m) {
+    Module* module = modules[m];
+    Index num_imports[kExternalKindCount] = {};
+    for (const Import* import_ : module->imports) {
+      const ExternalKind kind = import_->kind();
+      Index import_index = num_imports[static_cast<int>(kind)]++;
+      const ImportTarget& target = import_map[m].Get(kind)[import_index];
+      if (!target.is_resolved()) {
+        continue;
       }
-
-      // Grab the name of the item being exported
-      Index export_index = libmodule->export_bindings.FindIndex(field_name); 
-      if (export_index == -1) {
-        std::cout << "Module imports a function that does not exist as an export. Desired import: " << field_name << " from module: " << import_->module_name << std::endl;
-        exit(1);
+      std::string* name = EntityName(module, kind, import_index);
+      const std::string* target_name = EntityName(modules[target.module], kind, target.index);
+      if (!name || !target_name || target_name->empty()) {
+        return Result::Error;
       }
-      Export* export_ = libmodule->exports[export_index];
-      string export_name;
-      
-      switch (export_->kind) {
-        case ExternalKind::Func:
-          if (Func* func = libmodule->GetFunc(export_->var)) {
-            export_name = func->name;
-          }
-          break;
 
-        case ExternalKind::Table:
-          if (Table* table = libmodule->GetTable(export_->var)) {
-            export_name = table->name;
-          }
-          break;
-
-        case ExternalKind::Memory:
-          if (Memory* memory = libmodule->GetMemory(export_->var)) {
-            export_name = memory->name;
-          }
-          break;
-
-        case ExternalKind::Global:
-          if (Global* global = libmodule->GetGlobal(export_->var)) {
-            export_name = global->name;
-          }
-          break;
-
-        case ExternalKind::Tag:
-          if (Tag* tag = libmodule->GetTag(export_->var)) {
-            export_name = tag->name;
-          }
+      BindingHash& bindings = Bindings(module, kind);
+      auto range = bindings.equal_range(*name);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.index == import_index) {
+          bindings.erase(it);
           break;
+        }
       }
-
-      import_map->insert({name, export_name});
+      *name = *target_name;
+      bindings.emplace(*name, Binding(import_index));
     }
   }
-}
-
-}  // end anonymous namespace
-
-Result ResolveImports(Module* module, Module* libmodule, unordered_map<string, string>* import_map) {
-  ImportMapConstructor(module, libmodule, import_map);
-  ImportMapConstructor(libmodule, module, import_map);
-  ImportResolver resolver(import_map);
-  Result result = resolver.VisitModule(module);
-  result |= resolver.VisitModule(libmodule);
-  return result;
+  return Result::Ok;
 }
 
 }  // namespace wabt
@@ -17,15 +17,64 @@
 #ifndef WABT_RESOLVE_IMPORTS_H_
 #define WABT_RESOLVE_IMPORTS_H_
 
-#include <unordered_map>
+#include <vector>
 
 #include "wabt/common.h"
+#include "wabt/error.h"
 
 namespace wabt {
 
 struct Module;
 
-Result ResolveImports(struct Module*, struct Module*, std::unordered_map<std::string, std::string>*);
+// Where an imported entity is defined: the position of the exporting module
+// in the module list and the entity's index in that module.
+struct ImportTarget {
+  Index module = kInvalidIndex;
+  Index index = kInvalidIndex;
+
+  bool is_resolved() const { return module != kInvalidIndex; }
+};
+
+// Maps the import index of every import of one module to its target, one
+// flat table per kind. Imports from modules outside the link stay
+// unresolved.
+struct ModuleImportMap {
+  std::vector<ImportTarget>& Get(ExternalKind kind);
+  const std::vector<ImportTarget>& Get(ExternalKind kind) const;
+
+  std::vector<ImportTarget> funcs;
+  std::vector<ImportTarget> tables;
+  std::vector<ImportTarget> memories;
+  std::vector<ImportTarget> globals;
+  std::vector<ImportTarget> tags;
+};
+
+// One ModuleImportMap per module, in module list order.
+using ImportMap = std::vector<ModuleImportMap>;
+
+// Fills |import_map| with the target of every import of |modules| that is
+// provided by another module in |modules|. Modules are matched against
+// import module names by Module::name. Every export that is defined twice,
+// and every import from a linked module that doesn't export it, is reported
+// in |errors|.
+Result BuildImportMap(const std::vector<struct Module*>&, ImportMap*, Errors*);
+
+// Checks that every resolved import in |import_map| names an entity its
+// target can stand in for: a function or tag of the same signature, a
+// global of the same type and mutability, and a table or memory whose
+// limits are within the imported ones. These are the only properties of
+// validated inputs that linking them can break. Signatures are compared by
+// structural hash first. Every mismatch is reported with what the importer
+// and the defining module declare.
+Result CheckImportTargets(const std::vector<struct Module*>&, const ImportMap&, Errors*);
+
+// Gives every import of |modules| that |import_map| resolves the name of
+// the entity it resolves to. Must run after every entity has a name and
+// while references are still indices: ApplyNames then names each reference
+// to an import after its target, CombineModules drops the import, and
+// ResolveNames binds the reference to the target. Costs O(imports); the
+// function bodies are never visited.
+Result ResolveImports(const std::vector<struct Module*>&, const ImportMap&);
 
 }  // namespace wabt
 
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2016 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "symbol-index.h"
+
+#include <string>
+
+#include "wabt/ir.h"
+
+namespace wabt {
+
+namespace {
+
+Index GetExportIndex(const Module* module, const Export* export_) {
+  switch (export_->kind) {
+    case ExternalKind::Func:
+      return module->GetFuncIndex(export_->var);
+    case ExternalKind::Table:
+      return module->GetTableIndex(export_->var);
+    case ExternalKind::Memory:
+      return module->GetMemoryIndex(export_->var);
+    case ExternalKind::Global:
+      return module->GetGlobalIndex(export_->var);
+    case ExternalKind::Tag:
+      return module->GetTagIndex(export_->var);
+  }
+  return kInvalidIndex;
+}
+
+}  // end anonymous namespace
+
+// FNV-1a, with a byte that can't be part of a UTF-8 name between the two
+// halves of the key.
+uint64_t SymbolIndex::Hash(std::string_view module_name, std::string_view field_name) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  auto add = [&](uint8_t byte) {
+    hash ^= byte;
+    hash *= 0x100000001b3ull;
+  };
+  for (char c : module_name) {
+    add(static_cast<uint8_t>(c));
+  }
+  add(0xff);
+  for (char c : field_name) {
+    add(static_cast<uint8_t>(c));
+  }
+  // Linear probing uses the low bits, which FNV mixes least.
+  return hash ^ (hash >> 29);
+}
+
+void SymbolIndex::Prefetch(uint64_t hash) const {
+  __builtin_prefetch(&slots_[hash & (slots_.size() - 1)]);
+}
+
+size_t SymbolIndex::ProbeIndex(uint64_t hash,
+                               std::string_view module_name,
+                               std::string_view field_name) const {
+  const size_t mask = slots_.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    const Slot& slot = slots_[i];
+    if (slot.entry == kInvalidIndex) {
+      return i;
+    }
+    const Entry& entry = entries_[slot.entry];
+    if (slot.hash == hash && entry.field_name == field_name && entry.module_name == module_name) {
+      return i;
+    }
+  }
+}
+
+const Symbol* SymbolIndex::Find(uint64_t hash,
+                                std::string_view module_name,
+                                std::string_view field_name) const {
+  const Slot& slot = Probe(hash, module_name, field_name);
+  return slot.entry == kInvalidIndex ? nullptr : &entries_[slot.entry].symbol;
+}
+
+bool SymbolIndex::HasModule(std::string_view module_name, Index importer) const {
+  auto it = modules_by_name_.find(module_name);
+  if (it == modules_by_name_.end()) {
+    return false;
+  }
+  return it->second.first != importer || it->second.second != kInvalidIndex;
+}
+
+Result SymbolIndex::Build(const std::vector<Module*>& modules, Errors* errors) {
+  entries_.clear();
+  modules_by_name_.clear();
+  size_t num_exports = 0;
+  for (Index i = 0; i < modules.size(); ++i) {
+    num_exports += modules[i]->exports.size();
+    auto inserted = modules_by_name_.emplace(modules[i]->name, std::make_pair(i, kInvalidIndex));
+    if (!inserted.second && inserted.first->second.second == kInvalidIndex) {
+      inserted.first->second.second = i;
+    }
+  }
+  size_t num_slots = 16;
+  while (num_slots < 2 * num_exports) {
+    num_slots *= 2;
+  }
+  slots_.assign(num_slots, Slot{0, kInvalidIndex});
+  entries_.reserve(num_exports);
+
+  Result result = Result::Ok;
+  for (Index i = 0; i < modules.size(); ++i) {
+    const Module* module = modules[i];
+    for (const Export* export_ : module->exports) {
+      uint64_t hash = Hash(module->name, export_->name);
+      Slot& slot = Probe(hash, module->name, export_->name);
+      if (slot.entry != kInvalidIndex) {
+        const Symbol& existing = entries_[slot.entry].symbol;
+        std::string what = existing.kind == export_->kind
+                               ? std::string("duplicate export")
+                               : std::string("conflicting ") + GetKindName(existing.kind) + " and "
+                                     + GetKindName(export_->kind) + " exports";
+        std::string where = existing.module == i
+                                ? "is defined twice in module " + module->name
+                                : "is defined by two modules named " + module->name;
+        errors->emplace_back(ErrorLevel::Error, Location(),
+                             what + " \"" + export_->name + "\" " + where);
+        result = Result::Error;
+        continue;
+      }
+      slot.hash = hash;
+      slot.entry = entries_.size();
+      entries_.push_back(Entry{module->name, export_->name,
+                               Symbol{i, export_->kind, GetExportIndex(module, export_)}});
+    }
+  }
+  return result;
+}
+
+}  // namespace wabt
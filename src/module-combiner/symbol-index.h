@@ -0,0 +1,94 @@
+/*
+ * Copyright 2016 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WABT_SYMBOL_INDEX_H_
+#define WABT_SYMBOL_INDEX_H_
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "wabt/common.h"
+#include "wabt/error.h"
+
+namespace wabt {
+
+struct Module;
+
+// An exported entity: the position of its module in the module list, its
+// kind and its index in that module's index space.
+struct Symbol {
+  Index module;
+  ExternalKind kind;
+  Index index;
+};
+
+// Every export of every module, keyed by (module name, field name) in one
+// open-addressed table, so resolving an import is a single probe however
+// many modules are linked. Modules sharing a name share a namespace.
+class SymbolIndex {
+ public:
+  // Indexes the exports of |modules|, which must outlive the index. Reports
+  // every field exported twice under the same module name, whether as the
+  // same kind (a duplicate) or as different kinds (a conflict).
+  Result Build(const std::vector<Module*>& modules, Errors* errors);
+
+  static uint64_t Hash(std::string_view module_name, std::string_view field_name);
+
+  // Lookups are a probe of a random slot, so callers resolving many names
+  // hash and prefetch them all first.
+  void Prefetch(uint64_t hash) const;
+  const Symbol* Find(uint64_t hash, std::string_view module_name, std::string_view field_name) const;
+  const Symbol* Find(std::string_view module_name, std::string_view field_name) const {
+    return Find(Hash(module_name, field_name), module_name, field_name);
+  }
+
+  // Whether a module other than |importer| is named |module_name|.
+  bool HasModule(std::string_view module_name, Index importer) const;
+
+ private:
+  struct Entry {
+    std::string_view module_name;
+    std::string_view field_name;
+    Symbol symbol;
+  };
+  struct Slot {
+    uint64_t hash;
+    // Into |entries_|, or kInvalidIndex for an empty slot.
+    Index entry;
+  };
+
+  // Returns the slot holding the key or the empty slot it would go in.
+  size_t ProbeIndex(uint64_t hash, std::string_view module_name, std::string_view field_name) const;
+  const Slot& Probe(uint64_t hash, std::string_view module_name, std::string_view field_name) const {
+    return slots_[ProbeIndex(hash, module_name, field_name)];
+  }
+  Slot& Probe(uint64_t hash, std::string_view module_name, std::string_view field_name) {
+    return slots_[ProbeIndex(hash, module_name, field_name)];
+  }
+
+  std::vector<Entry> entries_;
+  // A power of two, at least twice the number of entries.
+  std::vector<Slot> slots_;
+  // The first two modules with each name, enough to answer HasModule.
+  std::unordered_map<std::string_view, std::pair<Index, Index>> modules_by_name_;
+};
+
+}  // namespace wabt
+
+#endif /* WABT_SYMBOL_INDEX_H_ */
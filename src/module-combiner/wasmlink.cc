@@ -14,11 +14,27 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cinttypes>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "wabt/apply-names.h"
 #include "wabt/binary-reader.h"
@@ -34,15 +50,32 @@
 #include "wabt/wast-lexer.h"
 #include "wabt/binary-writer.h"
 
+#include "access-checker.h"
+#include "arena.h"
+#include "batch-manifest.h"
+#include "coalesce-data-segments.h"
 #include "combine-modules.h"
+#include "content-hash.h"
+#include "deduplicate-types.h"
+#include "eliminate-dead-code.h"
+#include "file-output-stream.h"
 #include "generate-prefix-names.h"
+#include "inline-forwarding-stubs.h"
+#include "instrument-profile.h"
+#include "layout-functions.h"
+#include "link-cache.h"
+#include "link-protocol.h"
+#include "mapped-file.h"
+#include "merge-memories.h"
+#include "parallel.h"
+#include "parallel-binary-writer.h"
+#include "phase-stats.h"
 #include "resolve-imports.h"
 
 using namespace wabt;
 
 static int s_verbose;
-static std::string s_infile;
-static std::string s_lib_infile;
+static std::vector<std::string> s_infiles;
 static std::string s_outfile = "";
 static std::string s_infile_modname = "";
 static std::string s_lib_infile_modname = "";
@@ -52,18 +85,39 @@ static bool s_read_debug_names = true;
 static bool s_fail_on_custom_section_error = true;
 static std::unique_ptr<FileStream> s_log_stream;
 static bool s_validate = true;
+static bool s_trusted_combine = false;
 static WriteBinaryOptions s_write_binary_options;
+static unsigned s_num_threads = 0;
+static bool s_index_merge = false;
+static bool s_gc = false;
+static bool s_inline_stubs = false;
+static bool s_dedup_types = false;
+static bool s_merge_memories = false;
+static bool s_coalesce_data = false;
+static bool s_merge_tables = false;
+static Index s_rw_memory_index = 0;
+static std::string s_cache_dir;
+static bool s_stats = false;
+static bool s_arena = true;
+static std::string s_serve_socket;
+static std::string s_connect_socket;
+static std::string s_stats_json;
+static std::string s_profile_map;
+static std::string s_profile;
+static FunctionProfile s_function_profile;
 
 static const char s_description[] =
-R"(  Read two files in the WebAssembly binary format, and convert it to
-  the WebAssembly binary format, such that the output modules contain
-  all fields of the two input wasm module, and imports in one input wasm
-  file from the other wasm file are resolved as locals. File name must be
-  the same as module name.
+R"(  Read files in the WebAssembly binary format, and convert them to
+  the WebAssembly binary format, such that the output module contains
+  all fields of the input wasm modules, and imports in one input wasm
+  file from any other input wasm file are resolved as locals. File name
+  must be the same as module name.
 
 examples:
   # parse binary file moduleone.wasm and moduletwo.wasm write binary file output.wasm
   $ wasmlink moduleone.wasm moduletwo.wasm -o output.wasm
+  # link three modules at once
+  $ wasmlink app.wasm libc.wasm libm.wasm -o output.wasm
   # parse binary file moduleone.wasm with name env and moduletwo.wasm with name helper write binary file output.wasm
   $ wasmlink moduleone.wasm moduletwo.wasm -m env -n helper -o output.wasm
 )";
@@ -94,6 +148,12 @@ static void ParseOptions(int argc, char** argv) {
       [](const char* argument) {
         s_lib_infile_modname = argument;
       });
+  parser.AddOption(
+      'j', "jobs", "N",
+      "Number of threads, by default one per core",
+      [](const char* argument) {
+        s_num_threads = std::max(1, atoi(argument));
+      });
   s_features.AddOptions(&parser);
   parser.AddOption("no-debug-names", "Ignore debug names in the binary file",
                    []() { s_read_debug_names = false; });
@@ -104,18 +164,96 @@ static void ParseOptions(int argc, char** argv) {
                    []() { s_fail_on_custom_section_error = false; });
   parser.AddOption("no-check", "Don't check for invalid modules",
                    []() { s_validate = false; });
+  parser.AddOption("trusted-combine",
+                   "Validate the inputs and check that every resolved import matches its target,"
+                   " but don't validate the output again unless a pass rewrote it",
+                   []() { s_trusted_combine = true; });
   parser.AddOption("debug-names",
                    "Write debug names to the generated binary file",
                    []() { s_write_binary_options.write_debug_names = true; });
-  parser.AddArgument("first_filename", OptionParser::ArgumentCount::One,
-                     [](const char* argument) {
-                       s_infile = argument;
-                       ConvertBackslashToSlash(&s_infile);
-                     });
-  parser.AddArgument("second_filename", OptionParser::ArgumentCount::One,
+  parser.AddOption("index-merge",
+                   "Merge the inputs directly in index space instead of through generated names."
+                   " Debug names are only read when --debug-names is given",
+                   []() { s_index_merge = true; });
+  parser.AddOption("dedup-types",
+                   "Merge duplicate function types of the inputs into one",
+                   []() { s_dedup_types = true; });
+  parser.AddOption("inline-stubs",
+                   "Call the targets of functions that only forward their params to another call"
+                   " directly, and remove such stubs when nothing else refers to them",
+                   []() { s_inline_stubs = true; });
+  parser.AddOption("merge-memories",
+                   "Merge memories that are only used by the output into one, rebasing their"
+                   " accesses. Out-of-bounds accesses then reach the neighbouring memory instead"
+                   " of trapping, and the growing memory can grow only to 65536 pages minus its"
+                   " offset in the merged one",
+                   []() { s_merge_memories = true; });
+  parser.AddOption("merge-tables",
+                   "Merge tables that are only read by the output into one, rebasing their"
+                   " accesses. An out-of-range call_indirect then may call an element of the"
+                   " neighbouring table instead of trapping",
+                   []() { s_merge_tables = true; });
+  parser.AddOption("coalesce-data",
+                   "Merge contiguous active data segments and drop the zeros in them that the"
+                   " memory already starts with",
+                   []() { s_coalesce_data = true; });
+  parser.AddOption("profile", "FILE",
+                   "Put the functions of the output that FILE gives a hit count first, hottest"
+                   " first. FILE has a function name and a count on every line",
+                   [](const char* argument) {
+                     s_profile = argument;
+                     ConvertBackslashToSlash(&s_profile);
+                   });
+  parser.AddOption("instrument-profile", "MAP",
+                   "Count the calls and loop iterations of every function of the output in i64"
+                   " globals and export __profile_dump(addr), which stores them to memory 0 at"
+                   " addr. Writes one line per counter to MAP: function index, name, and entry"
+                   " or loop:N",
+                   [](const char* argument) {
+                     s_profile_map = argument;
+                     ConvertBackslashToSlash(&s_profile_map);
+                   });
+  parser.AddOption("rw-memory-index", "N",
+                   "Memories before N are read-only for access-checker; --merge-memories keeps"
+                   " them apart from the others and prints the rw index of the output",
+                   [](const char* argument) { s_rw_memory_index = atoi(argument); });
+  parser.AddOption("gc",
+                   "Remove functions, globals, types and segments that are unreachable from the"
+                   " exports and start function of the output",
+                   []() { s_gc = true; });
+  parser.AddOption("cache-dir", "DIR",
+                   "Reuse the output of an earlier link with the same inputs, module names and"
+                   " options from DIR, and add new outputs to it",
+                   [](const char* argument) {
+                     s_cache_dir = argument;
+                     ConvertBackslashToSlash(&s_cache_dir);
+                   });
+  parser.AddOption("no-arena",
+                   "Allocate with malloc and destroy the IR at exit, e.g. for leak checkers",
+                   []() { s_arena = false; });
+  parser.AddOption("stats",
+                   "Print the wall time, peak RSS growth and IR size of every phase to stderr",
+                   []() { s_stats = true; });
+  parser.AddOption("stats-json", "FILENAME",
+                   "Write the same per-phase statistics to FILENAME as JSON",
+                   [](const char* argument) {
+                     s_stats_json = argument;
+                     ConvertBackslashToSlash(&s_stats_json);
+                   });
+  parser.AddOption("serve", "SOCKET",
+                   "Keep running and link the inputs of every request sent to the Unix socket"
+                   " SOCKET with the options given here, keeping inputs that recur prepared. Up to"
+                   " 4 requests are linked at a time, sharing the threads of -j",
+                   [](const char* argument) { s_serve_socket = argument; });
+  parser.AddOption("connect", "SOCKET",
+                   "Send the inputs to a wasmlink --serve listening on SOCKET instead of linking"
+                   " them here. The link options are the server's, so giving any is an error",
+                   [](const char* argument) { s_connect_socket = argument; });
+  // One or more, except with --serve.
+  parser.AddArgument("filename", OptionParser::ArgumentCount::ZeroOrMore,
                      [](const char* argument) {
-                       s_lib_infile = argument;
-                       ConvertBackslashToSlash(&s_lib_infile);
+                       s_infiles.push_back(argument);
+                       ConvertBackslashToSlash(&s_infiles.back());
                      });
   parser.Parse(argc, argv);
 }
@@ -124,77 +262,829 @@ std::string StripWasm(const std::string& file_name) {
   return file_name.substr(0, file_name.length() - 5);
 }
 
-int ProgramMain(int argc, char** argv) {
-  Result result;
-  Result result_lib;
+static std::string ModuleName(size_t index) {
+  if (index == 0 && !s_infile_modname.empty()) {
+    return s_infile_modname;
+  }
+  if (index == 1 && !s_lib_infile_modname.empty()) {
+    return s_lib_infile_modname;
+  }
+  return StripWasm(s_infiles[index]);
+}
 
-  InitStdio();
-  ParseOptions(argc, argv);
+struct LinkInput {
+  std::string filename;
+  MappedFile file;
+  // The input bytes: mapped from |file|, or owned by |bytes| when they came
+  // over a socket.
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  std::shared_ptr<const std::vector<uint8_t>> bytes;
+  Module module;
+  Errors errors;
+  Result result = Result::Ok;
+  std::vector<PhaseStat> stats;
+};
 
-  std::vector<uint8_t> file_data;
-  std::vector<uint8_t> lib_file_data;
-  result = ReadFile(s_infile.c_str(), &file_data);
-  result_lib = ReadFile(s_lib_infile.c_str(), &lib_file_data);
-  if (Succeeded(result) && Succeeded(result_lib)) {
-    Errors errors;
-    Module module;
-    Module libmodule;
-    Module output;
-    const bool kStopOnFirstError = true;
-    ReadBinaryOptions options(s_features, s_log_stream.get(),
-                              s_read_debug_names, kStopOnFirstError,
-                              s_fail_on_custom_section_error);
-    result = ReadBinaryIr(s_infile.c_str(), file_data.data(), file_data.size(),
-                          options, &errors, &module);
-    result_lib = ReadBinaryIr(s_lib_infile.c_str(), lib_file_data.data(), lib_file_data.size(),
-                              options, &errors, &libmodule);
-    module.name = !s_infile_modname.empty() ? s_infile_modname : StripWasm(s_infile);
-    libmodule.name = !s_lib_infile_modname.empty() ? s_lib_infile_modname : StripWasm(s_lib_infile);
-    if (Succeeded(result) && Succeeded(result_lib)) {
-      if (s_validate) {
-        ValidateOptions options(s_features);
-        result = ValidateModule(&module, &errors, options);
-        result_lib = ValidateModule(&libmodule, &errors, options);
+static bool CollectStats() {
+  return s_stats || !s_stats_json.empty();
+}
+
+// With --stats, records the phase |timer| has been measuring, with the size
+// of |modules| after it, and starts measuring the next phase.
+static void EndPhase(std::vector<PhaseStat>* stats,
+                     PhaseTimer* timer,
+                     const char* phase,
+                     const std::string& input,
+                     const std::vector<Module*>& modules) {
+  if (!CollectStats()) {
+    return;
+  }
+  PhaseStat stat = timer->Stop(phase, input, IrCounts());
+  for (const Module* module : modules) {
+    stat.counts += CountIr(*module);
+  }
+  stats->push_back(std::move(stat));
+  // Counting isn't part of the next phase.
+  timer->Restart();
+}
+
+static Result ReportStats(const std::vector<PhaseStat>& stats, const PhaseTimer& total) {
+  double total_seconds = total.Stop("total", "", IrCounts()).seconds;
+  if (s_stats) {
+    WriteStatsText(stats, total_seconds, stderr);
+  }
+  if (!s_stats_json.empty()) {
+    FILE* file = fopen(s_stats_json.c_str(), "w");
+    if (!file) {
+      fprintf(stderr, "unable to open %s for writing\n", s_stats_json.c_str());
+      return Result::Error;
+    }
+    std::string json = StatsJson(stats, total_seconds);
+    fwrite(json.data(), 1, json.size(), file);
+    fclose(file);
+  }
+  return Result::Ok;
+}
+
+// What the link relies on from a validated input: the entity counts and
+// the export table. An input whose IR yields the record already in the
+// cache was validated by an earlier link.
+static std::string PreparedRecord(const Module& module) {
+  std::string record = "funcs " + std::to_string(module.funcs.size())
+                       + " tables " + std::to_string(module.tables.size())
+                       + " memories " + std::to_string(module.memories.size())
+                       + " globals " + std::to_string(module.globals.size())
+                       + " tags " + std::to_string(module.tags.size())
+                       + " types " + std::to_string(module.types.size()) + "\n";
+  for (const Export* export_ : module.exports) {
+    const Var& var = export_->var;
+    record += JsonString(export_->name) + " " + GetKindName(export_->kind) + " "
+              + (var.is_index() ? std::to_string(var.index()) : var.name()) + "\n";
+  }
+  return record;
+}
+
+// Identifies the wasmlink build, so a rebuilt linker never reuses the cached
+// outputs or validations of the old one. Hashes the executable itself where
+// /proc/self/exe exists, and falls back to the compile time of this file
+// elsewhere.
+static const ContentHash& BuildId() {
+  static const ContentHash build_id = [] {
+    ContentHasher hasher;
+    hasher.Add("wasmlink-build-1");
+    MappedFile exe;
+    if (Succeeded(exe.Open("/proc/self/exe"))) {
+      hasher.Add(exe.data(), exe.size());
+    } else {
+      hasher.Add(__DATE__ " " __TIME__);
+    }
+    return hasher.hash();
+  }();
+  return build_id;
+}
+
+// Runs every stage that only depends on the input itself. Inputs are
+// prepared concurrently, so this must only touch |input|.
+static void PrepareInput(LinkInput* input, unsigned num_threads, const LinkCache* cache) {
+  const bool kStopOnFirstError = true;
+  // Without names the index merge has no use for debug names unless they are
+  // written out again.
+  bool read_debug_names = s_read_debug_names
+                          && (!s_index_merge || s_write_binary_options.write_debug_names);
+  ReadBinaryOptions options(s_features, s_log_stream.get(),
+                            read_debug_names, kStopOnFirstError,
+                            s_fail_on_custom_section_error);
+
+  ContentHash key;
+  if (cache && s_validate) {
+    ContentHasher hasher;
+    hasher.Add("wasmlink-prepared-1");
+    hasher.AddU64(BuildId().low);
+    hasher.AddU64(BuildId().high);
+    hasher.Add(input->data, input->size);
+#define WABT_FEATURE(variable, flag, default_, help) \
+    hasher.AddU64(s_features.variable##_enabled());
+#include "wabt/feature.def"
+#undef WABT_FEATURE
+    hasher.AddU64(read_debug_names);
+    hasher.AddU64(s_fail_on_custom_section_error);
+    key = hasher.hash();
+  }
+
+  Module* module = &input->module;
+  PhaseTimer timer;
+  std::string name = std::move(module->name);
+  input->file.AdviseSequential();
+  input->result = ReadBinaryIr(input->filename.c_str(), input->data, input->size, options,
+                               &input->errors, module);
+  module->name = std::move(name);
+  // The IR owns copies of everything it needs from the input bytes.
+  input->file.Release();
+  EndPhase(&input->stats, &timer, "read", input->filename, {module});
+
+  if (Succeeded(input->result) && s_validate) {
+    std::string cached;
+    std::string record;
+    if (cache) {
+      record = PreparedRecord(*module);
+    }
+    if (!cache || !cache->ReadRecord(key, ".prepared", &cached) || cached != record) {
+      ValidateOptions options(s_features);
+      input->result = ValidateModule(module, &input->errors, options);
+      if (Succeeded(input->result) && cache) {
+        cache->WriteRecord(key, ".prepared", record);
       }
+    }
+    EndPhase(&input->stats, &timer, "validate", input->filename, {module});
+  }
+
+  if (s_index_merge) {
+    return;
+  }
 
-      if (Succeeded(result) && Succeeded(result_lib)) {
-        result = GeneratePrefixNames(&module);
-        result_lib = GeneratePrefixNames(&libmodule);
+  // References are named in LinkPrepared, once imports are resolved.
+  if (Succeeded(input->result)) {
+    input->result = GeneratePrefixNames(module, PrefixNameOpts::PrefixNone, num_threads);
+    EndPhase(&input->stats, &timer, "prefix-names", input->filename, {module});
+  }
+}
+
+static Result WriteProfileMap(const Module& module, const std::vector<ProfileCounter>& counters) {
+  FILE* file = fopen(s_profile_map.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "unable to open %s for writing\n", s_profile_map.c_str());
+    return Result::Error;
+  }
+  for (const ProfileCounter& counter : counters) {
+    const std::string& name = module.funcs[counter.func]->name;
+    fprintf(file, "%" PRIindex " %s ", counter.func, name.empty() ? "-" : name.c_str());
+    if (counter.loop == kInvalidIndex) {
+      fprintf(file, "entry\n");
+    } else {
+      fprintf(file, "loop:%" PRIindex "\n", counter.loop);
+    }
+  }
+  return fclose(file) == 0 ? Result::Ok : Result::Error;
+}
+
+// Runs every stage that works on all inputs together, from resolving imports
+// to validating |output|. Consumes the prepared |modules|. |rw_memory_index|
+// receives the rw memory index of |output| when --merge-memories rebased
+// it, kInvalidIndex otherwise.
+static Result LinkPrepared(const std::vector<Module*>& modules,
+                           unsigned num_threads,
+                           Module* output,
+                           Index* rw_memory_index,
+                           Errors* errors,
+                           std::vector<PhaseStat>* stats,
+                           PhaseTimer* timer) {
+  Result result = Result::Ok;
+  *rw_memory_index = kInvalidIndex;
+  if (s_index_merge) {
+    ImportMap import_map;
+    result = BuildImportMap(modules, &import_map, errors);
+    if (Succeeded(result) && s_validate) {
+      result = CheckImportTargets(modules, import_map, errors);
+    }
+    EndPhase(stats, timer, "build-import-map", "", modules);
+    if (Succeeded(result)) {
+      result = CombineModulesByIndex(modules, import_map, output);
+      EndPhase(stats, timer, "combine", "", {output});
+    }
+  } else {
+    // Mismatches are found before any body is rewritten.
+    ImportMap import_map;
+    result = BuildImportMap(modules, &import_map, errors);
+    if (Succeeded(result) && s_validate) {
+      result = CheckImportTargets(modules, import_map, errors);
+    }
+    if (Succeeded(result)) {
+      result = ResolveImports(modules, import_map);
+    }
+    EndPhase(stats, timer, "resolve-imports", "", modules);
+    if (Succeeded(result)) {
+      std::vector<Result> results(modules.size());
+      ParallelFor(modules.size(), num_threads,
+                  [&](unsigned, size_t i) { results[i] = ApplyNames(modules[i]); });
+      for (Result module_result : results) {
+        result |= module_result;
       }
+      EndPhase(stats, timer, "apply-names", "", modules);
+    }
+    if (Succeeded(result)) {
+      result = CombineModules(modules, output);
+      EndPhase(stats, timer, "combine", "", {output});
+    }
+  }
+
+  if (Succeeded(result) && s_resolve_names && !s_index_merge) {
+    result = ResolveNamesModule(output, errors);
+    EndPhase(stats, timer, "resolve-names", "", {output});
+  }
+
+  if (Succeeded(result) && s_dedup_types) {
+    result = DeduplicateTypes(output);
+    EndPhase(stats, timer, "dedup-types", "", {output});
+  }
 
-      if (Succeeded(result) && Succeeded(result_lib)) {
-        result = ApplyNames(&module);
-        result_lib = ApplyNames(&libmodule);
+  if (Succeeded(result) && s_inline_stubs) {
+    result = InlineForwardingStubs(output);
+    EndPhase(stats, timer, "inline-stubs", "", {output});
+  }
+
+  if (Succeeded(result) && s_gc) {
+    result = EliminateDeadCode(output);
+    EndPhase(stats, timer, "gc", "", {output});
+  }
+
+  if (Succeeded(result) && s_merge_memories) {
+    std::vector<Index> memory_map;
+    result = MergeMemories(output, s_rw_memory_index, &memory_map);
+    EndPhase(stats, timer, "merge-memories", "", {output});
+    if (Succeeded(result) && s_rw_memory_index != 0) {
+      Index rw_index = RemapRwIndex(memory_map, s_rw_memory_index);
+      if (rw_index == kInvalidIndex) {
+        errors->emplace_back(ErrorLevel::Error, Location(),
+                             "merged memories mix both sides of --rw-memory-index");
+        result = Result::Error;
+      } else {
+        *rw_memory_index = rw_index;
       }
+    }
+  }
+
+  // After merge-memories, so segments of different inputs can be merged.
+  if (Succeeded(result) && s_coalesce_data) {
+    result = CoalesceDataSegments(output);
+    EndPhase(stats, timer, "coalesce-data", "", {output});
+  }
+
+  if (Succeeded(result) && s_merge_tables) {
+    result = MergeTables(output);
+    EndPhase(stats, timer, "merge-tables", "", {output});
+  }
+
+  if (Succeeded(result) && !s_profile.empty()) {
+    result = LayoutFunctions(output, s_function_profile);
+    EndPhase(stats, timer, "layout-functions", "", {output});
+  }
+
+  // Last, so the counters are for the functions that are written.
+  if (Succeeded(result) && !s_profile_map.empty()) {
+    std::vector<ProfileCounter> counters;
+    result = InstrumentProfile(output, &counters, errors);
+    if (Succeeded(result)) {
+      result = WriteProfileMap(*output, counters);
+    }
+    EndPhase(stats, timer, "instrument-profile", "", {output});
+  }
+
+  // Combining validated inputs whose imports match their targets keeps the
+  // output valid; the passes above rewrite it, so their output is checked.
+  bool rewritten = s_dedup_types || s_gc || s_inline_stubs || s_merge_memories
+                   || s_coalesce_data || s_merge_tables || !s_profile.empty()
+                   || !s_profile_map.empty();
+  if (Succeeded(result) && s_validate && (!s_trusted_combine || rewritten)) {
+    ValidateOptions options(s_features);
+    result = ValidateModule(output, errors, options);
+    EndPhase(stats, timer, "validate", "", {output});
+  }
+  return result;
+}
+
+// The parallel writer needs every reference to be an index, and only the
+// index merge and ResolveNamesModule leave the output that way.
+static unsigned WriteThreads(unsigned num_threads) {
+  return s_index_merge || s_resolve_names ? num_threads : 1;
+}
+
+// Hashes everything the output is a function of: the linker build, the input
+// bytes, the module names, the features and every option that changes what
+// is written.
+static ContentHash LinkCacheKey(const std::vector<std::unique_ptr<LinkInput>>& inputs) {
+  ContentHasher hasher;
+  hasher.AddU64(BuildId().low);
+  hasher.AddU64(BuildId().high);
+  for (const auto& input : inputs) {
+    hasher.Add(input->module.name);
+    hasher.Add(input->data, input->size);
+  }
+#define WABT_FEATURE(variable, flag, default_, help) \
+  hasher.AddU64(s_features.variable##_enabled());
+#include "wabt/feature.def"
+#undef WABT_FEATURE
+  const bool flags[] = {s_resolve_names, s_read_debug_names, s_fail_on_custom_section_error,
+                        s_validate, s_write_binary_options.write_debug_names, s_index_merge,
+                        s_gc, s_inline_stubs, s_dedup_types, s_merge_memories, s_merge_tables,
+                        s_coalesce_data, s_trusted_combine};
+  for (bool flag : flags) {
+    hasher.AddU64(flag);
+  }
+  hasher.AddU64(s_rw_memory_index);
+  std::vector<std::pair<std::string, uint64_t>> profile(s_function_profile.begin(),
+                                                        s_function_profile.end());
+  std::sort(profile.begin(), profile.end());
+  hasher.AddU64(profile.size());
+  for (const auto& [name, count] : profile) {
+    hasher.Add(name);
+    hasher.AddU64(count);
+  }
+  return hasher.hash();
+}
+
+// Prepared inputs kept resident by --serve, keyed by the hash of the module
+// name and bytes. Linking consumes the module of every input, so an input is
+// kept as its bytes plus one spare prepared module, and a new spare is
+// prepared in the background each time one is taken. An input only gets
+// spares once it was seen twice, so apps that change every time don't.
+class PreparedPool {
+ public:
+  static constexpr size_t kMaxEntries = 64;
+  // Bounds the input bytes of all entries; the prepared spares take memory
+  // in proportion to them.
+  static constexpr size_t kMaxBytes = size_t(256) << 20;
+
+  // Returns |request| prepared, as a spare if there is one. Inputs that
+  // aren't spares are prepared with |num_threads| threads.
+  std::unique_ptr<LinkInput> Take(LinkRequestInput* request, unsigned num_threads);
+
+ private:
+  using Key = std::pair<uint64_t, uint64_t>;
+
+  struct Entry {
+    std::string module_name;
+    std::string filename;
+    std::shared_ptr<const std::vector<uint8_t>> bytes;
+    std::unique_ptr<LinkInput> spare;
+    bool refilling = false;
+    unsigned uses = 0;
+    uint64_t last_use = 0;
+
+    bool Holds(const LinkRequestInput& request) const {
+      return module_name == request.module_name && bytes->size() == request.size
+             && memcmp(bytes->data(), request.data, request.size) == 0;
+    }
+  };
+
+  static std::unique_ptr<LinkInput> Prepare(const std::string& module_name,
+                                            const std::string& filename,
+                                            std::shared_ptr<const std::vector<uint8_t>> bytes,
+                                            unsigned num_threads);
+  // Runs on a thread of its own.
+  void Refill(Key key);
+  void EvictLocked();
+
+  std::mutex mutex_;
+  std::map<Key, Entry> entries_;
+  size_t total_bytes_ = 0;
+  uint64_t clock_ = 0;
+};
 
-      if (Succeeded(result) && Succeeded(result_lib)) {
-        std::unordered_map<std::string, std::string> import_map;
-        result = ResolveImports(&module, &libmodule, &import_map);
+std::unique_ptr<LinkInput> PreparedPool::Prepare(
+    const std::string& module_name,
+    const std::string& filename,
+    std::shared_ptr<const std::vector<uint8_t>> bytes,
+    unsigned num_threads) {
+  auto input = std::make_unique<LinkInput>();
+  input->filename = filename;
+  input->module.name = module_name;
+  input->data = bytes->data();
+  input->size = bytes->size();
+  input->bytes = std::move(bytes);
+  PrepareInput(input.get(), num_threads, nullptr);
+  return input;
+}
+
+std::unique_ptr<LinkInput> PreparedPool::Take(LinkRequestInput* request, unsigned num_threads) {
+  ContentHasher hasher;
+  hasher.Add(request->module_name);
+  hasher.Add(request->data, request->size);
+  Key key(hasher.hash().low, hasher.hash().high);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto [it, inserted] = entries_.try_emplace(key);
+  Entry& entry = it->second;
+  if (!inserted && !entry.Holds(*request)) {
+    // The hash isn't cryptographic, so a colliding input is prepared on its
+    // own instead of being handed the spare of another.
+    lock.unlock();
+    return Prepare(request->module_name, request->filename,
+                   std::make_shared<const std::vector<uint8_t>>(std::move(request->storage)),
+                   num_threads);
+  }
+  entry.last_use = ++clock_;
+  entry.uses++;
+  std::unique_ptr<LinkInput> input = std::move(entry.spare);
+  if (inserted) {
+    entry.module_name = request->module_name;
+    entry.filename = request->filename;
+    entry.bytes = std::make_shared<const std::vector<uint8_t>>(std::move(request->storage));
+    total_bytes_ += entry.bytes->size();
+  }
+  std::shared_ptr<const std::vector<uint8_t>> bytes = entry.bytes;
+  if (entry.uses >= 2 && !entry.refilling) {
+    entry.refilling = true;
+    std::thread(&PreparedPool::Refill, this, key).detach();
+  }
+  EvictLocked();
+  lock.unlock();
+
+  if (!input) {
+    // Diagnostics name the file of the request that first sent the input.
+    input = Prepare(request->module_name, request->filename, std::move(bytes), num_threads);
+  }
+  return input;
+}
+
+void PreparedPool::Refill(Key key) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return;
+  }
+  std::string module_name = it->second.module_name;
+  std::string filename = it->second.filename;
+  std::shared_ptr<const std::vector<uint8_t>> bytes = it->second.bytes;
+  lock.unlock();
+
+  const unsigned kNumThreads = 1;
+  std::unique_ptr<LinkInput> spare = Prepare(module_name, filename, std::move(bytes), kNumThreads);
+
+  lock.lock();
+  it = entries_.find(key);
+  if (it != entries_.end()) {
+    it->second.refilling = false;
+    // An input that doesn't prepare fails every link anyway.
+    if (Succeeded(spare->result) && !it->second.spare) {
+      it->second.spare = std::move(spare);
+    }
+  }
+}
+
+void PreparedPool::EvictLocked() {
+  while (entries_.size() > kMaxEntries || total_bytes_ > kMaxBytes) {
+    auto oldest = entries_.begin();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->second.last_use < oldest->second.last_use) {
+        oldest = it;
       }
+    }
+    total_bytes_ -= oldest->second.bytes->size();
+    entries_.erase(oldest);
+  }
+}
 
-      if (Succeeded(result)) {
-        result = CombineModules(&module, &libmodule, &output);
+static LinkResponse ServeLink(PreparedPool* pool, LinkRequest* request, unsigned num_threads) {
+  LinkResponse response;
+  Result result = Result::Ok;
+  Errors errors;
+  std::vector<std::unique_ptr<LinkInput>> inputs;
+  std::vector<Module*> modules;
+  for (LinkRequestInput& request_input : request->inputs) {
+    for (const Module* module : modules) {
+      if (module->name == request_input.module_name) {
+        response.status = 1;
+        response.diagnostics = "Module name " + module->name + " is used by more than one input\n";
+        return response;
       }
-      
-      if (Succeeded(result) && s_resolve_names) {
-        result = ResolveNamesModule(&output, &errors);
+    }
+    inputs.push_back(pool->Take(&request_input, num_threads));
+    modules.push_back(&inputs.back()->module);
+    result |= inputs.back()->result;
+    errors.insert(errors.end(), inputs.back()->errors.begin(), inputs.back()->errors.end());
+  }
+
+  Module output;
+  Index rw_memory_index = kInvalidIndex;
+  std::vector<PhaseStat> stats;
+  PhaseTimer timer;
+  if (Succeeded(result)) {
+    result = LinkPrepared(modules, num_threads, &output, &rw_memory_index, &errors, &stats,
+                          &timer);
+  }
+  if (Succeeded(result)) {
+    MemoryStream stream;
+    result = WriteBinaryModuleParallel(&stream, &output, s_write_binary_options,
+                                       WriteThreads(num_threads));
+    response.output = std::move(stream.output_buffer().data);
+  }
+  // Formatted while the inputs, which the error locations refer to, are alive.
+  response.diagnostics = FormatErrorsToString(errors, Location::Type::Binary);
+  if (Succeeded(result) && rw_memory_index != kInvalidIndex) {
+    response.diagnostics +=
+        "rw memory index of the output: " + std::to_string(rw_memory_index) + "\n";
+  }
+  response.status = result != Result::Ok;
+  if (response.status) {
+    response.output.clear();
+  }
+  return response;
+}
+
+static int ServeMain() {
+  int listen_fd = ListenUnixSocket(s_serve_socket);
+  if (listen_fd < 0) {
+    return 1;
+  }
+  // Requests are served concurrently, and the log stream isn't thread-safe.
+  s_log_stream.reset();
+  // Never destroyed: the refill threads it starts may outlive any scope.
+  PreparedPool* pool = new PreparedPool();
+  // At most kMaxConcurrentLinks requests are linked at a time, sharing the
+  // threads of -j between them; further connections wait to be accepted.
+  const unsigned kMaxConcurrentLinks = 4;
+  unsigned threads_per_link =
+      std::max<unsigned>(1, NumWorkers(s_num_threads, SIZE_MAX) / kMaxConcurrentLinks);
+  // Static, since the detached link threads use them.
+  static std::mutex links_mutex;
+  static std::condition_variable link_done;
+  static unsigned num_links = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(links_mutex);
+      link_done.wait(lock, [&] { return num_links < kMaxConcurrentLinks; });
+      num_links++;
+    }
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      int error = errno;
+      {
+        std::lock_guard<std::mutex> lock(links_mutex);
+        num_links--;
+      }
+      if (error == EINTR || error == ECONNABORTED) {
+        continue;
+      }
+      std::cerr << "accept failed: " << strerror(error) << std::endl;
+      return 1;
+    }
+    // One request per connection, each on a thread of its own.
+    std::thread([pool, fd, threads_per_link]() {
+      LinkRequest request;
+      if (Succeeded(ReceiveLinkRequest(fd, &request))) {
+        SendLinkResponse(fd, ServeLink(pool, &request, threads_per_link));
+      }
+      close(fd);
+      std::lock_guard<std::mutex> lock(links_mutex);
+      num_links--;
+      link_done.notify_one();
+    }).detach();
+  }
+}
+
+// The options given that change the link, which a --connect client can't
+// pass on: the server links with its own.
+static std::vector<std::string> LinkOptionsGiven() {
+  std::vector<std::string> given;
+  const Features default_features;
+#define WABT_FEATURE(variable, flag, default_, help)                                     \
+  if (s_features.variable##_enabled() != default_features.variable##_enabled()) {       \
+    given.push_back(s_features.variable##_enabled() ? "--enable-" flag : "--disable-" flag); \
+  }
+#include "wabt/feature.def"
+#undef WABT_FEATURE
+  const std::pair<bool, const char*> options[] = {
+      {!s_resolve_names, "--no-resolve-names"},
+      {!s_read_debug_names, "--no-debug-names"},
+      {!s_fail_on_custom_section_error, "--ignore-custom-section-errors"},
+      {!s_validate, "--no-check"},
+      {s_trusted_combine, "--trusted-combine"},
+      {s_write_binary_options.write_debug_names, "--debug-names"},
+      {s_index_merge, "--index-merge"},
+      {s_dedup_types, "--dedup-types"},
+      {s_inline_stubs, "--inline-stubs"},
+      {s_merge_memories, "--merge-memories"},
+      {s_merge_tables, "--merge-tables"},
+      {s_coalesce_data, "--coalesce-data"},
+      {!s_profile.empty(), "--profile"},
+      {!s_profile_map.empty(), "--instrument-profile"},
+      {s_rw_memory_index != 0, "--rw-memory-index"},
+      {s_gc, "--gc"},
+      {!s_cache_dir.empty(), "--cache-dir"},
+  };
+  for (const auto& [is_given, name] : options) {
+    if (is_given) {
+      given.push_back(name);
+    }
+  }
+  return given;
+}
+
+static int ConnectMain() {
+  LinkRequest request;
+  std::vector<std::unique_ptr<MappedFile>> files;
+  for (size_t i = 0; i < s_infiles.size(); ++i) {
+    files.push_back(std::make_unique<MappedFile>());
+    if (Failed(files.back()->Open(s_infiles[i]))) {
+      return 1;
+    }
+    request.inputs.emplace_back();
+    LinkRequestInput& input = request.inputs.back();
+    input.module_name = ModuleName(i);
+    input.filename = s_infiles[i];
+    input.data = files.back()->data();
+    input.size = files.back()->size();
+  }
+
+  int fd = ConnectUnixSocket(s_connect_socket);
+  if (fd < 0) {
+    return 1;
+  }
+  LinkResponse response;
+  Result result = SendLinkRequest(fd, request);
+  if (Succeeded(result)) {
+    result = ReceiveLinkResponse(fd, &response);
+  }
+  close(fd);
+  if (Failed(result)) {
+    std::cerr << "lost the connection to " << s_connect_socket << std::endl;
+    return 1;
+  }
+
+  fwrite(response.diagnostics.data(), 1, response.diagnostics.size(), stderr);
+  if (response.status != 0) {
+    return 1;
+  }
+  FileOutputStream stream;
+  result = stream.Open(s_outfile);
+  if (Succeeded(result)) {
+    stream.WriteData(response.output.data(), response.output.size());
+    result = stream.Close();
+    if (Failed(result)) {
+      std::remove(s_outfile.c_str());
+    }
+  }
+  return result != Result::Ok;
+}
+
+int ProgramMain(int argc, char** argv) {
+  Result result = Result::Ok;
+
+  InitStdio();
+  ParseOptions(argc, argv);
+  s_write_binary_options.features = s_features;
+  if (!s_profile.empty() && Failed(ReadFunctionProfile(s_profile, &s_function_profile))) {
+    return 1;
+  }
+
+  if (!s_serve_socket.empty()) {
+    if (!s_profile_map.empty()) {
+      std::cerr << "--instrument-profile writes one map per link and can't be used with --serve"
+                << std::endl;
+      return 1;
+    }
+    return ServeMain();
+  }
+  if (s_infiles.empty()) {
+    std::cerr << "No input files, use --serve to link inputs sent over a socket" << std::endl;
+    return 1;
+  }
+  if (!s_connect_socket.empty()) {
+    std::vector<std::string> ignored = LinkOptionsGiven();
+    if (!ignored.empty()) {
+      std::cerr << "--connect links with the options of the server; remove";
+      for (const std::string& option : ignored) {
+        std::cerr << " " << option;
       }
+      std::cerr << std::endl;
+      return 1;
+    }
+    return ConnectMain();
+  }
 
-      if (Succeeded(result) && s_validate) {
-        ValidateOptions options(s_features);
-        result = ValidateModule(&output, &errors, options);
+  if (s_arena) {
+    EnableArena();
+  }
+
+  const PhaseTimer total_timer;
+  PhaseTimer timer;
+  std::vector<PhaseStat> stats;
+
+  std::vector<std::unique_ptr<LinkInput>> inputs;
+  std::vector<Module*> modules;
+  Module output;
+  for (size_t i = 0; i < s_infiles.size(); ++i) {
+    inputs.push_back(std::make_unique<LinkInput>());
+    inputs.back()->filename = s_infiles[i];
+    inputs.back()->module.name = ModuleName(i);
+    modules.push_back(&inputs.back()->module);
+    for (size_t j = 0; j < i; ++j) {
+      if (modules[i]->name == modules[j]->name) {
+        std::cerr << "Module name " << modules[i]->name << " is used by both " << s_infiles[j]
+                  << " and " << s_infiles[i] << std::endl;
+        result = Result::Error;
       }
+    }
+  }
+
+  for (auto& input : inputs) {
+    result |= input->file.Open(input->filename);
+    input->data = input->file.data();
+    input->size = input->file.size();
+  }
+
+  // A hit skips everything below. The rw index that --merge-memories prints
+  // and the --instrument-profile map aren't part of the entry, so those links
+  // always run.
+  std::unique_ptr<LinkCache> cache;
+  ContentHash cache_key;
+  if (Succeeded(result) && !s_cache_dir.empty()
+      && !(s_merge_memories && s_rw_memory_index != 0) && s_profile_map.empty()) {
+    cache = std::make_unique<LinkCache>(s_cache_dir);
+    cache_key = LinkCacheKey(inputs);
+    if (cache->Fetch(cache_key, s_outfile)) {
+      EndPhase(&stats, &timer, "cache-hit", "", {});
+      return ReportStats(stats, total_timer) != Result::Ok;
+    }
+    EndPhase(&stats, &timer, "cache-lookup", "", {});
+  }
+
+  if (Succeeded(result)) {
+    Errors errors;
+    // Inputs also skip validation when an earlier link validated them.
+    std::unique_ptr<LinkCache> prepared_cache;
+    if (!s_cache_dir.empty()) {
+      prepared_cache = std::make_unique<LinkCache>(s_cache_dir);
+    }
+
+    // The log stream is shared, so only prepare inputs concurrently when
+    // nothing is logged.
+    unsigned num_threads = s_log_stream ? 1 : s_num_threads;
+    // Threads left over once every input has one shard its function bodies.
+    unsigned threads_per_input =
+        std::max<unsigned>(1, NumWorkers(num_threads, SIZE_MAX) / inputs.size());
+    ParallelFor(inputs.size(), num_threads, [&](unsigned, size_t i) {
+      PrepareInput(inputs[i].get(), threads_per_input, prepared_cache.get());
+    });
+
+    // Merge in input order so that diagnostics stay deterministic.
+    for (auto& input : inputs) {
+      result |= input->result;
+      std::move(input->errors.begin(), input->errors.end(), std::back_inserter(errors));
+      std::move(input->stats.begin(), input->stats.end(), std::back_inserter(stats));
+    }
+    // The wall time of the input phases together, however they overlapped.
+    EndPhase(&stats, &timer, "prepare", "", modules);
 
+    Index rw_memory_index = kInvalidIndex;
+    if (Succeeded(result)) {
+      result = LinkPrepared(modules, s_num_threads, &output, &rw_memory_index, &errors, &stats,
+                            &timer);
+    }
+    if (Succeeded(result) && rw_memory_index != kInvalidIndex) {
+      std::cerr << "rw memory index of the output: " << rw_memory_index << std::endl;
+    }
+
+    if (Succeeded(result)) {
+      FileOutputStream stream;
+      result = stream.Open(s_outfile);
       if (Succeeded(result)) {
-        MemoryStream stream;
-        s_write_binary_options.features = s_features;
-        result = WriteBinaryModule(&stream, &output, s_write_binary_options);
-        stream.WriteToFile(s_outfile);
+        result = WriteBinaryModuleParallel(&stream, &output, s_write_binary_options,
+                                           WriteThreads(s_num_threads));
+        result |= stream.Close();
+        if (Failed(result)) {
+          std::remove(s_outfile.c_str());
+        }
       }
+      EndPhase(&stats, &timer, "write", "", {&output});
+    }
+
+    // Failing to fill the cache doesn't fail the link.
+    if (Succeeded(result) && cache) {
+      cache->Store(cache_key, s_outfile);
     }
     FormatErrorsToFile(errors, Location::Type::Binary);
   }
-  return result != Result::Ok || result_lib != Result::Ok;
+  if (CollectStats()) {
+    result |= ReportStats(stats, total_timer);
+  }
+  // The inputs and the output are still alive here; without the arena they
+  // are destroyed on the way out, which is what leak checkers expect.
+  if (s_arena) {
+    FastExit(result != Result::Ok);
+  }
+  return result != Result::Ok;
 }
 
 int main(int argc, char** argv) {
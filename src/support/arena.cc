@@ -0,0 +1,143 @@
+#include "arena.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <sys/mman.h>
+
+namespace wabt {
+
+namespace {
+
+constexpr size_t kChunkSize = 1 << 20;
+constexpr size_t kMaxArenaAllocation = 64 << 10;
+constexpr size_t kAlignment = alignof(std::max_align_t);
+
+// Set once by EnableArena, before there are other threads.
+uintptr_t s_arena_begin = 0;
+uintptr_t s_arena_end = 0;
+std::atomic<uintptr_t> s_next_chunk{0};
+
+// The chunk the current thread allocates from. Trivial, so accessing it
+// needs no initialization guard.
+struct ThreadChunk {
+  uintptr_t next;
+  uintptr_t end;
+  uintptr_t last;
+};
+thread_local ThreadChunk t_chunk;
+
+size_t RoundUp(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+bool IsArena(const void* p) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(p);
+  return address >= s_arena_begin && address < s_arena_end;
+}
+
+void* ArenaAllocate(size_t size) {
+  if (s_arena_begin == 0 || size > kMaxArenaAllocation) {
+    return nullptr;
+  }
+  size = size == 0 ? kAlignment : RoundUp(size);
+  ThreadChunk& chunk = t_chunk;
+  if (chunk.end - chunk.next < size) {
+    uintptr_t begin = s_next_chunk.fetch_add(kChunkSize, std::memory_order_relaxed);
+    if (begin >= s_arena_end || s_arena_end - begin < kChunkSize) {
+      return nullptr;
+    }
+    chunk.next = begin;
+    chunk.end = begin + kChunkSize;
+  }
+  chunk.last = chunk.next;
+  chunk.next += size;
+  return reinterpret_cast<void*>(chunk.last);
+}
+
+// Gives the latest allocation of this thread back; anything else stays
+// allocated until exit.
+void ArenaRelease(void* p, size_t size) {
+  ThreadChunk& chunk = t_chunk;
+  uintptr_t address = reinterpret_cast<uintptr_t>(p);
+  if (address == chunk.last && address + (size == 0 ? kAlignment : RoundUp(size)) == chunk.next) {
+    chunk.next = address;
+    chunk.last = 0;
+  }
+}
+
+void* Allocate(size_t size) {
+  if (void* p = ArenaAllocate(size)) {
+    return p;
+  }
+  if (void* p = malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void Deallocate(void* p) {
+  if (!IsArena(p)) {
+    free(p);
+  }
+}
+
+void Deallocate(void* p, size_t size) {
+  if (IsArena(p)) {
+    ArenaRelease(p, size);
+  } else {
+    free(p);
+  }
+}
+
+}  // end anonymous namespace
+
+bool EnableArena(size_t reserve_bytes) {
+  if (s_arena_begin != 0) {
+    return true;
+  }
+  // Only reserves address space; pages are backed as chunks touch them.
+  void* p = mmap(nullptr, reserve_bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  s_arena_begin = reinterpret_cast<uintptr_t>(p);
+  s_arena_end = s_arena_begin + reserve_bytes;
+  s_next_chunk.store(s_arena_begin, std::memory_order_relaxed);
+  return true;
+}
+
+void FastExit(int status) {
+  fflush(nullptr);
+  _Exit(status);
+}
+
+}  // namespace wabt
+
+void* operator new(size_t size) {
+  return wabt::Allocate(size);
+}
+
+void* operator new[](size_t size) {
+  return wabt::Allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+  wabt::Deallocate(p);
+}
+
+void operator delete[](void* p) noexcept {
+  wabt::Deallocate(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+  wabt::Deallocate(p, size);
+}
+
+void operator delete[](void* p, size_t size) noexcept {
+  wabt::Deallocate(p, size);
+}
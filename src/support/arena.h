@@ -0,0 +1,33 @@
+#ifndef WABT_ARENA_H_
+#define WABT_ARENA_H_
+
+#include <cstddef>
+
+namespace wabt {
+
+constexpr size_t kDefaultArenaReserve = size_t(64) << 30;
+
+// Bump allocation for the IR of short-lived tool runs. The IR allocates each
+// node with plain new, so this works at the level of operator new, which
+// the arena library replaces for every binary that links it. Until
+// EnableArena() is called, and for allocations above 64 KiB, operator new
+// and delete just use malloc and free.
+//
+// Once enabled, small allocations are carved out of one reserved address
+// range, in 1 MiB chunks owned by one thread each. That keeps the nodes a
+// thread builds next to each other, and it leaves no allocator locks to
+// contend for. Deleting arena memory frees nothing, except that the latest
+// allocation of the calling thread is rolled back. Only tools that build
+// their IR once and then exit should enable the arena.
+//
+// Must be called before any thread is started. Returns false, leaving
+// allocation to malloc, if the range can't be reserved.
+bool EnableArena(size_t reserve_bytes = kDefaultArenaReserve);
+
+// Flushes stdio and ends the process without running destructors, so the
+// IR isn't torn down one node at a time just before exit.
+[[noreturn]] void FastExit(int status);
+
+}  // namespace wabt
+
+#endif /* WABT_ARENA_H_ */
@@ -0,0 +1,97 @@
+#include "batch-manifest.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace wabt {
+
+namespace {
+
+bool StartsWith(const std::string& s, std::string_view prefix) {
+  return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+Result ParseLine(const std::string& filename,
+                 size_t line_number,
+                 const std::string& line,
+                 std::vector<BatchEntry>* entries) {
+  std::istringstream fields(line);
+  std::string field;
+  if (!(fields >> field) || field[0] == '#') {
+    return Result::Ok;
+  }
+
+  BatchEntry entry;
+  entry.filename = field;
+  while (fields >> field) {
+    if (StartsWith(field, "allow:")) {
+      entry.allowed.push_back(field.substr(6));
+    } else if (StartsWith(field, "deny:")) {
+      entry.denied.push_back(field.substr(5));
+    } else if (entry.output.empty()) {
+      entry.output = field;
+    } else {
+      fprintf(stderr, "%s:%zu: unexpected field \"%s\"\n", filename.c_str(), line_number,
+              field.c_str());
+      return Result::Error;
+    }
+  }
+  entries->push_back(std::move(entry));
+  return Result::Ok;
+}
+
+}  // end anonymous namespace
+
+Result ReadBatchManifest(const std::string& filename, std::vector<BatchEntry>* entries) {
+  std::ifstream file;
+  std::istream* in = &std::cin;
+  if (filename != "-") {
+    file.open(filename);
+    if (!file) {
+      fprintf(stderr, "unable to read manifest %s\n", filename.c_str());
+      return Result::Error;
+    }
+    in = &file;
+  }
+
+  Result result = Result::Ok;
+  std::string line;
+  for (size_t line_number = 1; std::getline(*in, line); ++line_number) {
+    result |= ParseLine(filename, line_number, line, entries);
+  }
+  return result;
+}
+
+std::string JsonString(std::string_view value) {
+  std::string out = "\"";
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escape[8];
+          snprintf(escape, sizeof(escape), "\\u%04x", c);
+          out += escape;
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+  return out;
+}
+
+}  // namespace wabt
@@ -0,0 +1,34 @@
+#ifndef WABT_BATCH_MANIFEST_H_
+#define WABT_BATCH_MANIFEST_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+// One input of a batch run. Non-empty policy lists replace the policy given
+// on the command line for this input only.
+struct BatchEntry {
+  std::string filename;
+  std::string output;
+  std::vector<std::string> allowed;
+  std::vector<std::string> denied;
+};
+
+// Appends the entries of the manifest |filename|, one input per line:
+//
+//   FILENAME [OUTPUT] [allow:NAME]... [deny:NAME]...
+//
+// Fields are separated by whitespace. Blank lines and lines starting with '#'
+// are skipped. "-" reads the manifest from stdin.
+Result ReadBatchManifest(const std::string& filename, std::vector<BatchEntry>* entries);
+
+// Returns |value| as a quoted JSON string.
+std::string JsonString(std::string_view value);
+
+}  // namespace wabt
+
+#endif /* WABT_BATCH_MANIFEST_H_ */
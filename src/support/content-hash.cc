@@ -0,0 +1,123 @@
+#include "content-hash.h"
+
+#include <cstring>
+
+namespace wabt {
+
+namespace {
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t FinalMix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdull;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ull;
+  k ^= k >> 33;
+  return k;
+}
+
+uint64_t LoadU64(const uint8_t* p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+constexpr uint64_t kC1 = 0x87c37b91114253d5ull;
+constexpr uint64_t kC2 = 0x4cf5ad432745937full;
+
+}  // end anonymous namespace
+
+std::string ContentHash::ToHex() const {
+  static const char kDigits[] = "0123456789abcdef";
+  std::string hex(32, '0');
+  for (int i = 0; i < 16; ++i) {
+    hex[15 - i] = kDigits[(high >> (4 * i)) & 0xf];
+    hex[31 - i] = kDigits[(low >> (4 * i)) & 0xf];
+  }
+  return hex;
+}
+
+void ContentHasher::Add(const void* data, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  const size_t num_blocks = size / 16;
+  uint64_t h1 = state_.low;
+  uint64_t h2 = state_.high;
+
+  for (size_t i = 0; i < num_blocks; ++i) {
+    uint64_t k1 = LoadU64(p + i * 16);
+    uint64_t k2 = LoadU64(p + i * 16 + 8);
+
+    k1 *= kC1;
+    k1 = RotateLeft(k1, 31);
+    k1 *= kC2;
+    h1 ^= k1;
+    h1 = RotateLeft(h1, 27);
+    h1 += h2;
+    h1 = h1 * 5 + 0x52dce729;
+
+    k2 *= kC2;
+    k2 = RotateLeft(k2, 33);
+    k2 *= kC1;
+    h2 ^= k2;
+    h2 = RotateLeft(h2, 31);
+    h2 += h1;
+    h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  const uint8_t* tail = p + num_blocks * 16;
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  switch (size & 15) {
+    case 15: k2 ^= uint64_t(tail[14]) << 48; [[fallthrough]];
+    case 14: k2 ^= uint64_t(tail[13]) << 40; [[fallthrough]];
+    case 13: k2 ^= uint64_t(tail[12]) << 32; [[fallthrough]];
+    case 12: k2 ^= uint64_t(tail[11]) << 24; [[fallthrough]];
+    case 11: k2 ^= uint64_t(tail[10]) << 16; [[fallthrough]];
+    case 10: k2 ^= uint64_t(tail[9]) << 8; [[fallthrough]];
+    case 9:
+      k2 ^= uint64_t(tail[8]);
+      k2 *= kC2;
+      k2 = RotateLeft(k2, 33);
+      k2 *= kC1;
+      h2 ^= k2;
+      [[fallthrough]];
+    case 8: k1 ^= uint64_t(tail[7]) << 56; [[fallthrough]];
+    case 7: k1 ^= uint64_t(tail[6]) << 48; [[fallthrough]];
+    case 6: k1 ^= uint64_t(tail[5]) << 40; [[fallthrough]];
+    case 5: k1 ^= uint64_t(tail[4]) << 32; [[fallthrough]];
+    case 4: k1 ^= uint64_t(tail[3]) << 24; [[fallthrough]];
+    case 3: k1 ^= uint64_t(tail[2]) << 16; [[fallthrough]];
+    case 2: k1 ^= uint64_t(tail[1]) << 8; [[fallthrough]];
+    case 1:
+      k1 ^= uint64_t(tail[0]);
+      k1 *= kC1;
+      k1 = RotateLeft(k1, 31);
+      k1 *= kC2;
+      h1 ^= k1;
+  }
+
+  h1 ^= size;
+  h2 ^= size;
+  h1 += h2;
+  h2 += h1;
+  h1 = FinalMix(h1);
+  h2 = FinalMix(h2);
+  h1 += h2;
+  h2 += h1;
+
+  state_.low = h1;
+  state_.high = h2;
+}
+
+void ContentHasher::AddU64(uint64_t value) {
+  uint8_t bytes[8];
+  for (int i = 0; i < 8; ++i) {
+    bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+  Add(bytes, sizeof(bytes));
+}
+
+}  // namespace wabt
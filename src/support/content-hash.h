@@ -0,0 +1,42 @@
+#ifndef WABT_CONTENT_HASH_H_
+#define WABT_CONTENT_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace wabt {
+
+struct ContentHash {
+  uint64_t low = 0;
+  uint64_t high = 0;
+
+  bool operator==(const ContentHash& other) const {
+    return low == other.low && high == other.high;
+  }
+  bool operator!=(const ContentHash& other) const { return !(*this == other); }
+
+  // 32 lowercase hex digits, usable as a file name.
+  std::string ToHex() const;
+};
+
+// 128-bit MurmurHash3 (x64 variant) over a sequence of pieces. Every piece
+// is hashed with the running state as its seed and its length mixed in, so
+// ("ab", "c") and ("a", "bc") hash differently. Not cryptographic: it keys
+// caches of trusted inputs, it doesn't authenticate them.
+class ContentHasher {
+ public:
+  void Add(const void* data, size_t size);
+  void Add(std::string_view value) { Add(value.data(), value.size()); }
+  void AddU64(uint64_t value);
+
+  ContentHash hash() const { return state_; }
+
+ private:
+  ContentHash state_;
+};
+
+}  // namespace wabt
+
+#endif /* WABT_CONTENT_HASH_H_ */
@@ -0,0 +1,196 @@
+#include "file-output-stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace wabt {
+
+FileOutputStream::FileOutputStream(size_t buffer_size, Stream* log_stream)
+    : Stream(log_stream), capacity_(std::max<size_t>(buffer_size, 1)) {
+  buffer_.reserve(capacity_);
+}
+
+FileOutputStream::~FileOutputStream() {
+  if (fd_ >= 0) {
+    Close();
+  }
+}
+
+Result FileOutputStream::Open(const std::string& filename) {
+  filename_ = filename;
+  fd_ = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd_ < 0) {
+    fprintf(stderr, "unable to open %s for writing: %s\n", filename.c_str(), strerror(errno));
+    return Result::Error;
+  }
+  buffer_.clear();
+  buffer_offset_ = 0;
+  return Result::Ok;
+}
+
+Result FileOutputStream::Close() {
+  if (fd_ < 0) {
+    return Result::Error;
+  }
+  Result result = Stream::result();
+  result |= FlushBuffer();
+  if (Succeeded(result) && ftruncate(fd_, offset()) < 0) {
+    fprintf(stderr, "unable to truncate %s: %s\n", filename_.c_str(), strerror(errno));
+    result = Result::Error;
+  }
+  if (close(fd_) < 0) {
+    result = Result::Error;
+  }
+  fd_ = -1;
+  return result;
+}
+
+Result FileOutputStream::PWriteAll(size_t offset, const void* data, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    ssize_t n = pwrite(fd_, p, size, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "unable to write %s: %s\n", filename_.c_str(), strerror(errno));
+      return Result::Error;
+    }
+    p += n;
+    offset += n;
+    size -= n;
+  }
+  return Result::Ok;
+}
+
+Result FileOutputStream::PReadAll(size_t offset, void* data, size_t size) {
+  uint8_t* p = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    ssize_t n = pread(fd_, p, size, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "unable to read back %s: %s\n", filename_.c_str(), strerror(errno));
+      return Result::Error;
+    }
+    if (n == 0) {
+      // Reading past the end of what was written; the writer never does
+      // this, but treat the missing bytes as the zeros a hole would read as.
+      memset(p, 0, size);
+      break;
+    }
+    p += n;
+    offset += n;
+    size -= n;
+  }
+  return Result::Ok;
+}
+
+Result FileOutputStream::FlushBuffer() {
+  if (buffer_.empty()) {
+    return Result::Ok;
+  }
+  CHECK_RESULT(PWriteAll(buffer_offset_, buffer_.data(), buffer_.size()));
+  buffer_offset_ = buffer_end();
+  buffer_.clear();
+  return Result::Ok;
+}
+
+Result FileOutputStream::WriteDataImpl(size_t offset, const void* data, size_t size) {
+  if (fd_ < 0) {
+    return Result::Error;
+  }
+  // An empty buffer restarts at the end of the stream; a fixup of earlier
+  // bytes mustn't move it there, or every later append would miss it.
+  if (buffer_.empty() && offset == this->offset()) {
+    buffer_offset_ = offset;
+  }
+
+  // Common case: appending to, or patching inside, the buffered region.
+  if (offset >= buffer_offset_ && offset <= buffer_end() && offset + size <= buffer_offset_ + capacity_) {
+    size_t start = offset - buffer_offset_;
+    if (start + size > buffer_.size()) {
+      buffer_.resize(start + size);
+    }
+    memcpy(buffer_.data() + start, data, size);
+    return Result::Ok;
+  }
+
+  // Appending past the buffer: write it out and start over at |offset|.
+  if (offset == buffer_end()) {
+    CHECK_RESULT(FlushBuffer());
+    if (size >= capacity_) {
+      CHECK_RESULT(PWriteAll(offset, data, size));
+      buffer_offset_ = offset + size;
+      return Result::Ok;
+    }
+    buffer_offset_ = offset;
+    buffer_.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+    return Result::Ok;
+  }
+
+  // A fixup of bytes that were already written out.
+  if (offset + size <= buffer_offset_ || offset >= buffer_end()) {
+    return PWriteAll(offset, data, size);
+  }
+  CHECK_RESULT(FlushBuffer());
+  return PWriteAll(offset, data, size);
+}
+
+Result FileOutputStream::MoveDataImpl(size_t dst_offset, size_t src_offset, size_t size) {
+  if (fd_ < 0) {
+    return Result::Error;
+  }
+  if (size == 0) {
+    return Result::Ok;
+  }
+
+  // Moves that stay inside the buffer, e.g. shrinking the size of a function
+  // body, never touch the file.
+  size_t end = std::max(dst_offset, src_offset) + size;
+  if (!buffer_.empty() && std::min(dst_offset, src_offset) >= buffer_offset_ && end <= buffer_end()) {
+    uint8_t* base = buffer_.data() - buffer_offset_;
+    memmove(base + dst_offset, base + src_offset, size);
+    return Result::Ok;
+  }
+
+  // Otherwise move through the file in chunks, in the direction that doesn't
+  // overwrite bytes before they are read.
+  CHECK_RESULT(FlushBuffer());
+  std::vector<uint8_t> chunk(std::min(size, capacity_));
+  size_t done = 0;
+  while (done < size) {
+    size_t n = std::min(chunk.size(), size - done);
+    size_t at = dst_offset < src_offset ? done : size - done - n;
+    CHECK_RESULT(PReadAll(src_offset + at, chunk.data(), n));
+    CHECK_RESULT(PWriteAll(dst_offset + at, chunk.data(), n));
+    done += n;
+  }
+  return Result::Ok;
+}
+
+Result FileOutputStream::TruncateImpl(size_t size) {
+  if (fd_ < 0) {
+    return Result::Error;
+  }
+  if (size >= buffer_offset_ && size <= buffer_end()) {
+    buffer_.resize(size - buffer_offset_);
+  } else {
+    CHECK_RESULT(FlushBuffer());
+    buffer_offset_ = size;
+  }
+  if (ftruncate(fd_, std::min(size, buffer_offset_)) < 0) {
+    fprintf(stderr, "unable to truncate %s: %s\n", filename_.c_str(), strerror(errno));
+    return Result::Error;
+  }
+  return Result::Ok;
+}
+
+}  // namespace wabt
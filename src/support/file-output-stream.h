@@ -0,0 +1,54 @@
+#ifndef WABT_FILE_OUTPUT_STREAM_H_
+#define WABT_FILE_OUTPUT_STREAM_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "wabt/common.h"
+#include "wabt/stream.h"
+
+namespace wabt {
+
+// Stream that writes straight to a file, for use with WriteBinaryModule in
+// place of a MemoryStream. Appends go through a fixed-size buffer; the size
+// fixups and moves done by the binary writer are applied in the buffer when
+// they fall inside it, and with pread/pwrite on the file otherwise. Memory
+// use is bounded by the buffer size, not by the size of the output.
+class FileOutputStream : public Stream {
+ public:
+  static constexpr size_t kDefaultBufferSize = 1 << 20;
+
+  explicit FileOutputStream(size_t buffer_size = kDefaultBufferSize, Stream* log_stream = nullptr);
+  FileOutputStream(const FileOutputStream&) = delete;
+  FileOutputStream& operator=(const FileOutputStream&) = delete;
+  ~FileOutputStream() override;
+
+  Result Open(const std::string& filename);
+
+  // Writes out buffered bytes and cuts the file at offset(). Must be called
+  // once writing is done for the result to be reported.
+  Result Close();
+
+ protected:
+  Result WriteDataImpl(size_t offset, const void* data, size_t size) override;
+  Result MoveDataImpl(size_t dst_offset, size_t src_offset, size_t size) override;
+  Result TruncateImpl(size_t size) override;
+
+ private:
+  size_t buffer_end() const { return buffer_offset_ + buffer_.size(); }
+  Result FlushBuffer();
+  Result PWriteAll(size_t offset, const void* data, size_t size);
+  Result PReadAll(size_t offset, void* data, size_t size);
+
+  std::string filename_;
+  int fd_ = -1;
+  size_t capacity_;
+  // Holds the file bytes [buffer_offset_, buffer_end()) not yet written out.
+  std::vector<uint8_t> buffer_;
+  size_t buffer_offset_ = 0;
+};
+
+}  // namespace wabt
+
+#endif /* WABT_FILE_OUTPUT_STREAM_H_ */
@@ -0,0 +1,109 @@
+#include "link-cache.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file-output-stream.h"
+#include "mapped-file.h"
+
+namespace wabt {
+
+namespace {
+
+Result CopyFile(const std::string& from, const std::string& to) {
+  MappedFile file;
+  CHECK_RESULT(file.Open(from));
+  file.AdviseSequential();
+  FileOutputStream stream;
+  CHECK_RESULT(stream.Open(to));
+  stream.WriteData(file.data(), file.size());
+  Result result = stream.Close();
+  if (Failed(result)) {
+    std::remove(to.c_str());
+  }
+  return result;
+}
+
+bool IsRegularFile(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+}  // end anonymous namespace
+
+std::string LinkCache::EntryPath(const ContentHash& key, const char* suffix) const {
+  return dir_ + "/" + key.ToHex() + suffix;
+}
+
+Result LinkCache::CreateDir() const {
+  if (mkdir(dir_.c_str(), 0777) < 0 && errno != EEXIST) {
+    fprintf(stderr, "unable to create cache directory %s: %s\n", dir_.c_str(), strerror(errno));
+    return Result::Error;
+  }
+  return Result::Ok;
+}
+
+std::string LinkCache::TempPath(const std::string& path) const {
+  static std::atomic<unsigned> s_next_temp{0};
+  return path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(s_next_temp++);
+}
+
+Result LinkCache::Publish(const std::string& temp, const std::string& path) const {
+  if (rename(temp.c_str(), path.c_str()) < 0) {
+    fprintf(stderr, "unable to add %s to the cache: %s\n", path.c_str(), strerror(errno));
+    std::remove(temp.c_str());
+    return Result::Error;
+  }
+  return Result::Ok;
+}
+
+bool LinkCache::Fetch(const ContentHash& key, const std::string& outfile) const {
+  std::string path = EntryPath(key);
+  if (!IsRegularFile(path)) {
+    return false;
+  }
+  return Succeeded(CopyFile(path, outfile));
+}
+
+Result LinkCache::Store(const ContentHash& key, const std::string& outfile) const {
+  CHECK_RESULT(CreateDir());
+  std::string path = EntryPath(key);
+  std::string temp = TempPath(path);
+  CHECK_RESULT(CopyFile(outfile, temp));
+  return Publish(temp, path);
+}
+
+bool LinkCache::ReadRecord(const ContentHash& key, const char* suffix, std::string* contents) const {
+  std::string path = EntryPath(key, suffix);
+  if (!IsRegularFile(path)) {
+    return false;
+  }
+  MappedFile file;
+  if (Failed(file.Open(path))) {
+    return false;
+  }
+  contents->assign(reinterpret_cast<const char*>(file.data()), file.size());
+  return true;
+}
+
+Result LinkCache::WriteRecord(const ContentHash& key, const char* suffix, std::string_view contents) const {
+  CHECK_RESULT(CreateDir());
+  std::string path = EntryPath(key, suffix);
+  std::string temp = TempPath(path);
+  FileOutputStream stream;
+  CHECK_RESULT(stream.Open(temp));
+  stream.WriteData(contents.data(), contents.size());
+  Result result = stream.Close();
+  if (Failed(result)) {
+    std::remove(temp.c_str());
+    return result;
+  }
+  return Publish(temp, path);
+}
+
+}  // namespace wabt
@@ -0,0 +1,52 @@
+#ifndef WABT_LINK_CACHE_H_
+#define WABT_LINK_CACHE_H_
+
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "wabt/common.h"
+
+#include "content-hash.h"
+
+namespace wabt {
+
+// Directory of link outputs named by the hash of everything the output
+// depends on. Entries are copied in and out rather than hardlinked: the
+// output is opened with O_TRUNC by the next link that writes it, which would
+// clobber a shared inode.
+class LinkCache {
+ public:
+  explicit LinkCache(std::string dir) : dir_(std::move(dir)) {}
+
+  std::string EntryPath(const ContentHash& key, const char* suffix = ".wasm") const;
+
+  // Copies the entry for |key| to |outfile|. Returns false when there is no
+  // such entry or it can't be copied; |outfile| is then left for the link to
+  // write.
+  bool Fetch(const ContentHash& key, const std::string& outfile) const;
+
+  // Adds |outfile| as the entry for |key|, creating the directory if needed.
+  // The entry is renamed into place once complete, so concurrent links never
+  // fetch a partial entry.
+  Result Store(const ContentHash& key, const std::string& outfile) const;
+
+  // Small records kept next to the outputs, e.g. what is known about one
+  // input, named by |key| and |suffix|. ReadRecord returns false when there
+  // is no such record.
+  bool ReadRecord(const ContentHash& key, const char* suffix, std::string* contents) const;
+  Result WriteRecord(const ContentHash& key, const char* suffix, std::string_view contents) const;
+
+ private:
+  Result CreateDir() const;
+  // Name for a file that is renamed to |path| once complete. Unique across
+  // processes and threads.
+  std::string TempPath(const std::string& path) const;
+  Result Publish(const std::string& temp, const std::string& path) const;
+
+  std::string dir_;
+};
+
+}  // namespace wabt
+
+#endif /* WABT_LINK_CACHE_H_ */
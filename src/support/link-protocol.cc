@@ -0,0 +1,255 @@
+#include "link-protocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace wabt {
+
+namespace {
+
+constexpr uint32_t kRequestMagic = 0x4b4e4c57;   // "WLNK"
+constexpr uint32_t kResponseMagic = 0x53524c57;  // "WLRS"
+constexpr uint32_t kVersion = 1;
+
+// Bounds on what a peer may ask the other side to allocate.
+constexpr uint32_t kMaxInputs = 1024;
+constexpr uint32_t kMaxStringSize = 64 << 20;
+constexpr uint64_t kMaxModuleSize = uint64_t(4) << 30;
+// Of all the inputs of one request together.
+constexpr uint64_t kMaxRequestSize = uint64_t(1) << 30;
+// Buffers grow by at most this much ahead of the bytes received.
+constexpr size_t kReceiveChunkSize = 1 << 20;
+
+Result SendAll(int fd, const void* data, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    // The peer going away must not kill a daemon with SIGPIPE.
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return Result::Error;
+    }
+    p += n;
+    size -= n;
+  }
+  return Result::Ok;
+}
+
+Result ReceiveAll(int fd, void* data, size_t size) {
+  uint8_t* p = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    ssize_t n = recv(fd, p, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return Result::Error;
+    }
+    p += n;
+    size -= n;
+  }
+  return Result::Ok;
+}
+
+// Receives |size| bytes into |out|, growing it as they arrive rather than
+// up front, so a peer announcing more than it sends can't make this side
+// commit the memory.
+template <typename Container>
+Result ReceiveChunked(int fd, uint64_t size, Container* out) {
+  out->clear();
+  while (out->size() < size) {
+    size_t offset = out->size();
+    size_t chunk = std::min<uint64_t>(kReceiveChunkSize, size - offset);
+    out->resize(offset + chunk);
+    CHECK_RESULT(ReceiveAll(fd, &(*out)[offset], chunk));
+  }
+  return Result::Ok;
+}
+
+class MessageWriter {
+ public:
+  void U32(uint32_t value) { Append(value, 4); }
+  void U64(uint64_t value) { Append(value, 8); }
+  void String(const std::string& value) {
+    U32(value.size());
+    buffer_.insert(buffer_.end(), value.begin(), value.end());
+  }
+
+  // Sends what was written so far, then |size| bytes at |data| without
+  // copying them.
+  Result Flush(int fd, const void* data = nullptr, size_t size = 0) {
+    CHECK_RESULT(SendAll(fd, buffer_.data(), buffer_.size()));
+    buffer_.clear();
+    return SendAll(fd, data, size);
+  }
+
+ private:
+  void Append(uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      buffer_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  std::vector<uint8_t> buffer_;
+};
+
+Result ReceiveU32(int fd, uint32_t* value) {
+  uint8_t bytes[4];
+  CHECK_RESULT(ReceiveAll(fd, bytes, sizeof(bytes)));
+  *value = 0;
+  for (int i = 0; i < 4; ++i) {
+    *value |= uint32_t(bytes[i]) << (8 * i);
+  }
+  return Result::Ok;
+}
+
+Result ReceiveU64(int fd, uint64_t* value) {
+  uint8_t bytes[8];
+  CHECK_RESULT(ReceiveAll(fd, bytes, sizeof(bytes)));
+  *value = 0;
+  for (int i = 0; i < 8; ++i) {
+    *value |= uint64_t(bytes[i]) << (8 * i);
+  }
+  return Result::Ok;
+}
+
+Result ReceiveString(int fd, std::string* value) {
+  uint32_t size;
+  CHECK_RESULT(ReceiveU32(fd, &size));
+  if (size > kMaxStringSize) {
+    return Result::Error;
+  }
+  return ReceiveChunked(fd, size, value);
+}
+
+Result ReceiveHeader(int fd, uint32_t magic) {
+  uint32_t value;
+  CHECK_RESULT(ReceiveU32(fd, &value));
+  if (value != magic) {
+    return Result::Error;
+  }
+  CHECK_RESULT(ReceiveU32(fd, &value));
+  return value == kVersion ? Result::Ok : Result::Error;
+}
+
+bool SetSocketPath(const std::string& path, sockaddr_un* address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address->sun_path)) {
+    fprintf(stderr, "socket path too long: %s\n", path.c_str());
+    return false;
+  }
+  memcpy(address->sun_path, path.c_str(), path.size());
+  return true;
+}
+
+}  // end anonymous namespace
+
+int ListenUnixSocket(const std::string& path) {
+  sockaddr_un address;
+  if (!SetSocketPath(path, &address)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    fprintf(stderr, "unable to create socket: %s\n", strerror(errno));
+    return -1;
+  }
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+      || listen(fd, SOMAXCONN) < 0) {
+    fprintf(stderr, "unable to listen on %s: %s\n", path.c_str(), strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int ConnectUnixSocket(const std::string& path) {
+  sockaddr_un address;
+  if (!SetSocketPath(path, &address)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    fprintf(stderr, "unable to create socket: %s\n", strerror(errno));
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+    fprintf(stderr, "unable to connect to %s: %s\n", path.c_str(), strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+Result SendLinkRequest(int fd, const LinkRequest& request) {
+  MessageWriter writer;
+  writer.U32(kRequestMagic);
+  writer.U32(kVersion);
+  writer.U32(request.inputs.size());
+  for (const LinkRequestInput& input : request.inputs) {
+    writer.String(input.module_name);
+    writer.String(input.filename);
+    writer.U64(input.size);
+    CHECK_RESULT(writer.Flush(fd, input.data, input.size));
+  }
+  return writer.Flush(fd);
+}
+
+Result ReceiveLinkRequest(int fd, LinkRequest* request) {
+  CHECK_RESULT(ReceiveHeader(fd, kRequestMagic));
+  uint32_t num_inputs;
+  CHECK_RESULT(ReceiveU32(fd, &num_inputs));
+  if (num_inputs > kMaxInputs) {
+    return Result::Error;
+  }
+  request->inputs.resize(num_inputs);
+  uint64_t request_size = 0;
+  for (LinkRequestInput& input : request->inputs) {
+    CHECK_RESULT(ReceiveString(fd, &input.module_name));
+    CHECK_RESULT(ReceiveString(fd, &input.filename));
+    uint64_t size;
+    CHECK_RESULT(ReceiveU64(fd, &size));
+    if (size > kMaxModuleSize || size > kMaxRequestSize - request_size) {
+      return Result::Error;
+    }
+    request_size += size;
+    CHECK_RESULT(ReceiveChunked(fd, size, &input.storage));
+    input.data = input.storage.data();
+    input.size = size;
+  }
+  return Result::Ok;
+}
+
+Result SendLinkResponse(int fd, const LinkResponse& response) {
+  MessageWriter writer;
+  writer.U32(kResponseMagic);
+  writer.U32(kVersion);
+  writer.U32(response.status);
+  writer.String(response.diagnostics);
+  writer.U64(response.output.size());
+  return writer.Flush(fd, response.output.data(), response.output.size());
+}
+
+Result ReceiveLinkResponse(int fd, LinkResponse* response) {
+  CHECK_RESULT(ReceiveHeader(fd, kResponseMagic));
+  CHECK_RESULT(ReceiveU32(fd, &response->status));
+  CHECK_RESULT(ReceiveString(fd, &response->diagnostics));
+  uint64_t size;
+  CHECK_RESULT(ReceiveU64(fd, &size));
+  if (size > kMaxModuleSize) {
+    return Result::Error;
+  }
+  return ReceiveChunked(fd, size, &response->output);
+}
+
+}  // namespace wabt
@@ -0,0 +1,54 @@
+#ifndef WABT_LINK_PROTOCOL_H_
+#define WABT_LINK_PROTOCOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+// Messages between `wasmlink --connect` and `wasmlink --serve`, one request
+// and one response per connection over a Unix stream socket. Integers are
+// little-endian; every message starts with a magic word and a version.
+
+struct LinkRequestInput {
+  std::string module_name;
+  // Only used in diagnostics.
+  std::string filename;
+  // The module bytes. A sender may point them anywhere; a received input
+  // points them into |storage|.
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  std::vector<uint8_t> storage;
+};
+
+struct LinkRequest {
+  std::vector<LinkRequestInput> inputs;
+};
+
+struct LinkResponse {
+  // 0 on success, like the exit status of a local link.
+  uint32_t status = 0;
+  // Formatted errors and warnings.
+  std::string diagnostics;
+  // The linked module, empty unless |status| is 0.
+  std::vector<uint8_t> output;
+};
+
+// Returns a listening socket bound to |path|, replacing a stale socket file,
+// or -1 after printing an error.
+int ListenUnixSocket(const std::string& path);
+// Returns a socket connected to |path|, or -1 after printing an error.
+int ConnectUnixSocket(const std::string& path);
+
+Result SendLinkRequest(int fd, const LinkRequest&);
+Result ReceiveLinkRequest(int fd, LinkRequest*);
+Result SendLinkResponse(int fd, const LinkResponse&);
+Result ReceiveLinkResponse(int fd, LinkResponse*);
+
+}  // namespace wabt
+
+#endif /* WABT_LINK_PROTOCOL_H_ */
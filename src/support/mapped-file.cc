@@ -0,0 +1,103 @@
+#include "mapped-file.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace wabt {
+
+MappedFile::~MappedFile() {
+  Release();
+}
+
+Result MappedFile::Open(const std::string& filename) {
+  Release();
+
+  if (filename == "-") {
+    return ReadAll(STDIN_FILENO, filename);
+  }
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "unable to read file %s: %s\n", filename.c_str(), strerror(errno));
+    return Result::Error;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    fprintf(stderr, "unable to stat file %s: %s\n", filename.c_str(), strerror(errno));
+    close(fd);
+    return Result::Error;
+  }
+
+  // mmap of an empty file fails, and pipes and devices can't be mapped at all.
+  if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+    Result result = ReadAll(fd, filename);
+    close(fd);
+    return result;
+  }
+
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      fprintf(stderr, "unable to read file %s: %s\n", filename.c_str(), strerror(errno));
+      return Result::Error;
+    }
+    Result result = ReadAll(fd, filename);
+    close(fd);
+    return result;
+  }
+
+  data_ = static_cast<const uint8_t*>(addr);
+  size_ = st.st_size;
+  mapped_ = true;
+  return Result::Ok;
+}
+
+Result MappedFile::ReadAll(int fd, const std::string& filename) {
+  buffer_.clear();
+  uint8_t chunk[65536];
+  while (true) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "unable to read file %s: %s\n", filename.c_str(), strerror(errno));
+      return Result::Error;
+    }
+    if (n == 0) {
+      break;
+    }
+    buffer_.insert(buffer_.end(), chunk, chunk + n);
+  }
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+  mapped_ = false;
+  return Result::Ok;
+}
+
+void MappedFile::AdviseSequential() {
+  if (mapped_) {
+    madvise(const_cast<uint8_t*>(data_), size_, MADV_SEQUENTIAL);
+  }
+}
+
+void MappedFile::Release() {
+  if (mapped_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  std::vector<uint8_t>().swap(buffer_);
+  data_ = nullptr;
+  size_ = 0;
+  mapped_ = false;
+}
+
+}  // namespace wabt
@@ -0,0 +1,49 @@
+#ifndef WABT_MAPPED_FILE_H_
+#define WABT_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "wabt/common.h"
+
+namespace wabt {
+
+// Read-only view of a whole input file. Regular files are memory-mapped, so
+// no copy is made; pipes, character devices and "-" (stdin) are read into an
+// owned buffer instead. Either way data() stays valid until Release() or
+// destruction.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  Result Open(const std::string& filename);
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool is_mapped() const { return mapped_; }
+
+  // Tells the kernel the mapping is about to be read front to back.
+  void AdviseSequential();
+
+  // Drops the contents once nothing refers into them any more, e.g. after IR
+  // construction. The pages of a mapping are returned to the kernel right
+  // away instead of staying resident until exit.
+  void Release();
+
+ private:
+  Result ReadAll(int fd, const std::string& filename);
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::vector<uint8_t> buffer_;
+};
+
+}  // namespace wabt
+
+#endif /* WABT_MAPPED_FILE_H_ */
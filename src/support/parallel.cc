@@ -0,0 +1,55 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace wabt {
+
+unsigned HardwareThreads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+unsigned NumWorkers(unsigned num_threads, size_t count) {
+  if (num_threads == 0) {
+    num_threads = HardwareThreads();
+  }
+  return static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(num_threads, count)));
+}
+
+void ParallelFor(size_t count,
+                 unsigned num_threads,
+                 const std::function<void(unsigned worker, size_t index)>& fn,
+                 size_t grain) {
+  unsigned num_workers = NumWorkers(num_threads, count);
+  if (num_workers == 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(0, i);
+    }
+    return;
+  }
+
+  grain = std::max<size_t>(grain, 1);
+  std::atomic<size_t> next {0};
+  auto run = [&](unsigned worker) {
+    for (size_t begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain)) {
+      size_t end = std::min(begin + grain, count);
+      for (size_t i = begin; i < end; ++i) {
+        fn(worker, i);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_workers - 1);
+  for (unsigned worker = 1; worker < num_workers; ++worker) {
+    threads.emplace_back(run, worker);
+  }
+  run(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace wabt
@@ -0,0 +1,28 @@
+#ifndef WABT_PARALLEL_H_
+#define WABT_PARALLEL_H_
+
+#include <cstddef>
+#include <functional>
+
+namespace wabt {
+
+// Returns the number of hardware threads, at least 1.
+unsigned HardwareThreads();
+
+// Number of workers ParallelFor uses for |count| items when asked for
+// |num_threads| threads. A |num_threads| of 0 means HardwareThreads().
+unsigned NumWorkers(unsigned num_threads, size_t count);
+
+// Calls |fn(worker, index)| for every index in [0, count). Indices are handed
+// out dynamically to NumWorkers(num_threads, count) threads, in runs of
+// |grain| consecutive indices; |worker| names the calling thread so callers
+// can keep per-thread state. With a single worker everything runs on the
+// calling thread, in order.
+void ParallelFor(size_t count,
+                 unsigned num_threads,
+                 const std::function<void(unsigned worker, size_t index)>& fn,
+                 size_t grain = 1);
+
+}  // namespace wabt
+
+#endif /* WABT_PARALLEL_H_ */
@@ -0,0 +1,124 @@
+#include "phase-stats.h"
+
+#include <sys/resource.h>
+
+#include "wabt/cast.h"
+#include "wabt/ir.h"
+
+#include "batch-manifest.h"
+
+namespace wabt {
+
+namespace {
+
+size_t CountExprs(const ExprList& exprs) {
+  size_t count = 0;
+  for (const Expr& expr : exprs) {
+    ++count;
+    switch (expr.type()) {
+      case ExprType::Block:
+        count += CountExprs(cast<BlockExpr>(&expr)->block.exprs);
+        break;
+      case ExprType::Loop:
+        count += CountExprs(cast<LoopExpr>(&expr)->block.exprs);
+        break;
+      case ExprType::If:
+        count += CountExprs(cast<IfExpr>(&expr)->true_.exprs);
+        count += CountExprs(cast<IfExpr>(&expr)->false_);
+        break;
+      case ExprType::Try: {
+        const TryExpr* try_ = cast<TryExpr>(&expr);
+        count += CountExprs(try_->block.exprs);
+        for (const Catch& catch_ : try_->catches) {
+          count += CountExprs(catch_.exprs);
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return count;
+}
+
+}  // end anonymous namespace
+
+IrCounts& IrCounts::operator+=(const IrCounts& other) {
+  funcs += other.funcs;
+  exprs += other.exprs;
+  names += other.names;
+  return *this;
+}
+
+IrCounts CountIr(const Module& module) {
+  IrCounts counts;
+  counts.funcs = module.funcs.size();
+  counts.names = module.func_bindings.size() + module.table_bindings.size()
+                 + module.memory_bindings.size() + module.global_bindings.size()
+                 + module.tag_bindings.size() + module.type_bindings.size()
+                 + module.data_segment_bindings.size() + module.elem_segment_bindings.size();
+  for (const Func* func : module.funcs) {
+    counts.exprs += CountExprs(func->exprs);
+    counts.names += func->bindings.size();
+  }
+  return counts;
+}
+
+long PeakRssKb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) < 0) {
+    return 0;
+  }
+  // ru_maxrss is in kilobytes on Linux.
+  return usage.ru_maxrss;
+}
+
+void PhaseTimer::Restart() {
+  start_ = std::chrono::steady_clock::now();
+  start_peak_rss_kb_ = PeakRssKb();
+}
+
+PhaseStat PhaseTimer::Stop(std::string phase, std::string input, const IrCounts& counts) const {
+  PhaseStat stat;
+  stat.phase = std::move(phase);
+  stat.input = std::move(input);
+  stat.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  stat.peak_rss_delta_kb = PeakRssKb() - start_peak_rss_kb_;
+  stat.counts = counts;
+  return stat;
+}
+
+void WriteStatsText(const std::vector<PhaseStat>& stats, double total_seconds, FILE* file) {
+  fprintf(file, "%-16s %10s %12s %8s %10s %8s  %s\n", "phase", "ms", "rss+ KiB", "funcs", "exprs",
+          "names", "input");
+  for (const PhaseStat& stat : stats) {
+    fprintf(file, "%-16s %10.3f %12ld %8zu %10zu %8zu  %s\n", stat.phase.c_str(),
+            stat.seconds * 1000, stat.peak_rss_delta_kb, stat.counts.funcs, stat.counts.exprs,
+            stat.counts.names, stat.input.c_str());
+  }
+  fprintf(file, "%-16s %10.3f %12ld\n", "total", total_seconds * 1000, PeakRssKb());
+}
+
+std::string StatsJson(const std::vector<PhaseStat>& stats, double total_seconds) {
+  char buffer[64];
+  std::string json = "{\"phases\":[";
+  for (size_t i = 0; i < stats.size(); ++i) {
+    const PhaseStat& stat = stats[i];
+    if (i != 0) {
+      json += ",";
+    }
+    snprintf(buffer, sizeof(buffer), "%.6f", stat.seconds);
+    json += "{\"phase\":" + JsonString(stat.phase) + ",\"input\":" + JsonString(stat.input)
+            + ",\"seconds\":" + buffer
+            + ",\"peak_rss_delta_kb\":" + std::to_string(stat.peak_rss_delta_kb)
+            + ",\"funcs\":" + std::to_string(stat.counts.funcs)
+            + ",\"exprs\":" + std::to_string(stat.counts.exprs)
+            + ",\"names\":" + std::to_string(stat.counts.names) + "}";
+  }
+  snprintf(buffer, sizeof(buffer), "%.6f", total_seconds);
+  json += std::string("],\"total_seconds\":") + buffer
+          + ",\"peak_rss_kb\":" + std::to_string(PeakRssKb()) + "}\n";
+  return json;
+}
+
+}  // namespace wabt
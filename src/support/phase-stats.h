@@ -0,0 +1,66 @@
+#ifndef WABT_PHASE_STATS_H_
+#define WABT_PHASE_STATS_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace wabt {
+
+struct Module;
+
+// Size of the IR a phase leaves behind.
+struct IrCounts {
+  size_t funcs = 0;
+  size_t exprs = 0;
+  // Names bound in the module and function binding hashes, i.e. those
+  // GeneratePrefixNames and ApplyNames deal with. Labels aren't counted.
+  size_t names = 0;
+
+  IrCounts& operator+=(const IrCounts& other);
+};
+
+IrCounts CountIr(const Module&);
+
+struct PhaseStat {
+  std::string phase;
+  // The input a per-input phase ran on, empty for phases of the whole link.
+  std::string input;
+  double seconds = 0;
+  // Growth of the process' peak resident set during the phase. Phases that
+  // run concurrently share it, so only the totals are exact then.
+  long peak_rss_delta_kb = 0;
+  IrCounts counts;
+};
+
+// Wall time and peak RSS since construction or the last Restart().
+class PhaseTimer {
+ public:
+  PhaseTimer() { Restart(); }
+
+  void Restart();
+  PhaseStat Stop(std::string phase, std::string input, const IrCounts& counts) const;
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+  long start_peak_rss_kb_ = 0;
+};
+
+// Peak resident set of the process so far.
+long PeakRssKb();
+
+// One line per phase, aligned for reading on a terminal, then a total line
+// with the peak RSS of the process. |total_seconds| is the wall time of the
+// whole run, which is less than the sum of the phases when some ran
+// concurrently.
+void WriteStatsText(const std::vector<PhaseStat>&, double total_seconds, FILE*);
+
+// {"phases":[{...},...],"total_seconds":N,"peak_rss_kb":N}, with the phases
+// in the order given. Field names are stable; new fields are only added.
+std::string StatsJson(const std::vector<PhaseStat>&, double total_seconds);
+
+}  // namespace wabt
+
+#endif /* WABT_PHASE_STATS_H_ */